@@ -0,0 +1,62 @@
+// Copyright © 2020 Mateus Carmo Martins de Freitas Barbosa
+//
+// This program is licensed under the GNU General Public License, version 3.
+// See LICENSE.txt.
+//
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "arena.h"
+
+static const size_t ARENA_MIN_CAPACITY = 16384;
+
+void frame_arena_init(FrameArena *arena) {
+    arena->base = NULL;
+    arena->capacity = 0;
+    arena->used = 0;
+    arena->overflow_size = 0;
+}
+
+void frame_arena_finish(FrameArena *arena) {
+    frame_arena_reset(arena);
+    free(arena->base);
+    arena->base = NULL;
+    arena->capacity = 0;
+}
+
+void frame_arena_reset(FrameArena *arena) {
+    for (char *block : arena->overflow) {
+        free(block);
+    }
+    arena->overflow.clear();
+    if (arena->overflow_size > 0) {
+        size_t capacity = arena->capacity > 0 ? arena->capacity : ARENA_MIN_CAPACITY;
+        while (capacity < arena->used + arena->overflow_size) {
+            capacity *= 2;
+        }
+        free(arena->base);
+        arena->base = static_cast<char*>(malloc(capacity));
+        arena->capacity = arena->base != NULL ? capacity : 0;
+        arena->overflow_size = 0;
+    }
+    arena->used = 0;
+}
+
+void *frame_arena_alloc(FrameArena *arena, size_t size, size_t align) {
+    uintptr_t start = reinterpret_cast<uintptr_t>(arena->base) + arena->used;
+    size_t padding = (align - start % align) % align;
+    if (arena->base != NULL && arena->used + padding + size <= arena->capacity) {
+        arena->used += padding + size;
+        return reinterpret_cast<void*>(start + padding);
+    }
+
+    // malloc's alignment is enough for everything we keep in here.
+    char *block = static_cast<char*>(malloc(size > 0 ? size : 1));
+    if (block == NULL) {
+        abort();
+    }
+    arena->overflow.push_back(block);
+    arena->overflow_size += size + align;
+    return block;
+}
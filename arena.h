@@ -0,0 +1,37 @@
+// Copyright © 2020 Mateus Carmo Martins de Freitas Barbosa
+//
+// This program is licensed under the GNU General Public License, version 3.
+// See LICENSE.txt.
+//
+
+#ifndef STACKTILE_ARENA_H
+#define STACKTILE_ARENA_H
+
+#include <stddef.h>
+#include <vector>
+
+// Scratch memory for a single frame. Allocating is bumping a pointer and
+// everything is freed at once by frame_arena_reset. Whatever doesn't fit
+// goes to separate blocks, and the arena grows to fit the whole frame from
+// then on, so steady state frames don't touch the heap at all.
+// Only for trivially destructible types: nothing is ever destroyed.
+struct FrameArena {
+    char *base;
+    size_t capacity;
+    size_t used;
+    std::vector<char*> overflow;
+    size_t overflow_size;
+};
+
+void frame_arena_init(FrameArena *arena);
+void frame_arena_finish(FrameArena *arena);
+void frame_arena_reset(FrameArena *arena);
+void *frame_arena_alloc(FrameArena *arena, size_t size, size_t align);
+
+// Uninitialized storage for count objects of type T.
+template<typename T>
+T *frame_arena_array(FrameArena *arena, size_t count) {
+    return static_cast<T*>(frame_arena_alloc(arena, count * sizeof(T), alignof(T)));
+}
+
+#endif /* STACKTILE_ARENA_H */
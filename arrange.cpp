@@ -0,0 +1,197 @@
+// Copyright © 2020 Mateus Carmo Martins de Freitas Barbosa
+//
+// This program is licensed under the GNU General Public License, version 3.
+// See LICENSE.txt.
+//
+
+#include <vector>
+#include <wayland-server-core.h>
+
+extern "C" {
+#define static
+
+#include <wlr/types/wlr_box.h>
+#include <wlr/types/wlr_cursor.h>
+#include <wlr/types/wlr_output.h>
+#include <wlr/types/wlr_seat.h>
+#include <wlr/types/wlr_xdg_shell.h>
+
+#undef static
+}
+
+#include "arrange.h"
+#include "output.h"
+#include "server.h"
+#include "tiling.h"
+#include "transaction.h"
+#include "view.h"
+
+// Queues the new geometry of every view the last change moved. Views
+// whose size stayed the same aren't configured, transaction_commit_dirty
+// only moves them.
+static void arrange_commit(Server *server, TileTree *tree) {
+    for (TileWindow *window : tree->changed) {
+        auto view = reinterpret_cast<View*>(window->data);
+        wlr_box geometry { window->box.x, window->box.y, window->box.width, window->box.height };
+        view_configure(view, &geometry);
+    }
+    tile_tree_clear_changed(tree);
+    transaction_commit_dirty(server);
+}
+
+static View *focused_view(Server *server) {
+    wlr_surface *surface = server->seat->keyboard_state.focused_surface;
+    return surface != NULL ? view_from_surface(surface) : NULL;
+}
+
+static Output *output_at(Server *server, double lx, double ly) {
+    Output *output;
+    wl_list_for_each(output, &server->outputs, link) {
+        if (wlr_box_contains_point(&output->layout_box, lx, ly)) {
+            return output;
+        }
+    }
+    if (wl_list_empty(&server->outputs)) {
+        return NULL;
+    }
+    return wl_container_of(server->outputs.next, output, link);
+}
+
+static void tile_view(View *view, Output *output, View *near) {
+    tile_insert_split(&output->tiles, &view->tile, near != NULL ? &near->tile : NULL);
+    arrange_commit(view->server, &output->tiles);
+}
+
+void arrange_view_map(View *view) {
+    Server *server = view->server;
+    if (!server->tiling || view->xdg_surface->toplevel->parent != NULL) {
+        return;
+    }
+    // New views go next to the focused one, or on the output under the
+    // pointer when it's floating.
+    View *focused = focused_view(server);
+    if (focused != NULL && focused->tile.tree != NULL) {
+        Output *output;
+        wl_list_for_each(output, &server->outputs, link) {
+            if (&output->tiles == focused->tile.tree) {
+                tile_view(view, output, focused);
+                return;
+            }
+        }
+    }
+    Output *output = output_at(server, server->cursor->x, server->cursor->y);
+    if (output != NULL) {
+        tile_view(view, output, NULL);
+    }
+}
+
+void arrange_view_unmap(View *view) {
+    TileTree *tree = view->tile.tree;
+    if (tree == NULL) {
+        return;
+    }
+    tile_remove(&view->tile);
+    arrange_commit(view->server, tree);
+}
+
+void arrange_outputs(Server *server) {
+    Output *output;
+    wl_list_for_each(output, &server->outputs, link) {
+        const wlr_box *box = &output->layout_box;
+        Box area { box->x, box->y, box->width, box->height };
+        tile_tree_set_area(&output->tiles, &area);
+        arrange_commit(server, &output->tiles);
+    }
+}
+
+void arrange_output_destroy(Output *output) {
+    Server *server = output->server;
+    std::vector<TileWindow*> windows;
+    tile_tree_windows(&output->tiles, &windows);
+    for (TileWindow *window : windows) {
+        tile_remove(window);
+    }
+    tile_tree_finish(&output->tiles);
+
+    Output *other = NULL;
+    Output *candidate;
+    wl_list_for_each(candidate, &server->outputs, link) {
+        if (candidate != output) {
+            other = candidate;
+            break;
+        }
+    }
+    if (other == NULL) {
+        // They float where they are until an output shows up.
+        return;
+    }
+    TileWindow *near = NULL;
+    for (TileWindow *window : windows) {
+        tile_insert_split(&other->tiles, window, near);
+        near = window;
+    }
+    arrange_commit(server, &other->tiles);
+}
+
+void arrange_focus(Server *server, uint32_t direction) {
+    View *view = focused_view(server);
+    if (view == NULL) {
+        return;
+    }
+    TileWindow *neighbor = tile_neighbor(&view->tile, direction);
+    if (neighbor != NULL) {
+        auto next = reinterpret_cast<View*>(neighbor->data);
+        focus_view(next, next->xdg_surface->surface);
+    }
+}
+
+void arrange_move(Server *server, uint32_t direction) {
+    View *view = focused_view(server);
+    if (view == NULL || view->tile.tree == NULL) {
+        return;
+    }
+    TileTree *tree = view->tile.tree;
+    tile_move(&view->tile, direction);
+    // It's the active window of whatever stack it landed in.
+    view_raise(view);
+    arrange_commit(server, tree);
+}
+
+void arrange_grow(Server *server, uint32_t direction, double amount) {
+    View *view = focused_view(server);
+    if (view == NULL || view->tile.tree == NULL) {
+        return;
+    }
+    tile_grow(&view->tile, direction, amount);
+    arrange_commit(server, view->tile.tree);
+}
+
+void arrange_cycle_stack(Server *server) {
+    View *view = focused_view(server);
+    if (view == NULL || view->tile.tree == NULL) {
+        return;
+    }
+    auto next = reinterpret_cast<View*>(tile_stack_next(&view->tile)->data);
+    focus_view(next, next->xdg_surface->surface);
+}
+
+void arrange_toggle_floating(Server *server) {
+    View *view = focused_view(server);
+    if (view == NULL) {
+        return;
+    }
+    if (view->tile.tree != NULL) {
+        // The view stays where it is, above the tiles.
+        arrange_view_unmap(view);
+        view_raise(view);
+        return;
+    }
+    Output *output = output_at(
+        server,
+        view->box.x + view->box.width / 2.0,
+        view->box.y + view->box.height / 2.0
+    );
+    if (output != NULL) {
+        tile_view(view, output, NULL);
+    }
+}
@@ -0,0 +1,36 @@
+// Copyright © 2020 Mateus Carmo Martins de Freitas Barbosa
+//
+// This program is licensed under the GNU General Public License, version 3.
+// See LICENSE.txt.
+//
+
+#ifndef STACKTILE_ARRANGE_H
+#define STACKTILE_ARRANGE_H
+
+#include <stdint.h>
+
+struct Output;
+struct Server;
+struct View;
+
+// Keeps views tiled in the TileTree of their output, see tiling.h. Every
+// change is sent to the views it moved as a single transaction. Views with
+// a parent, like dialogs, float, and so do views toggled out of the tree.
+
+void arrange_view_map(View *view);
+void arrange_view_unmap(View *view);
+
+// Fits every tree to its output's box in the layout.
+void arrange_outputs(Server *server);
+// Moves the output's views into another output's tree.
+void arrange_output_destroy(Output *output);
+
+// Keybinding actions on the focused view. Directions are one of EDGE_LEFT,
+// EDGE_RIGHT, EDGE_TOP and EDGE_BOTTOM.
+void arrange_focus(Server *server, uint32_t direction);
+void arrange_move(Server *server, uint32_t direction);
+void arrange_grow(Server *server, uint32_t direction, double amount);
+void arrange_cycle_stack(Server *server);
+void arrange_toggle_floating(Server *server);
+
+#endif /* STACKTILE_ARRANGE_H */
@@ -0,0 +1,425 @@
+// Copyright © 2020 Mateus Carmo Martins de Freitas Barbosa
+//
+// This program is licensed under the GNU General Public License, version 3.
+// See LICENSE.txt.
+//
+
+#include <getopt.h>
+#include <math.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <vector>
+#include <wayland-server-core.h>
+
+extern "C" {
+#define static
+
+#include <wlr/backend/headless.h>
+#include <wlr/interfaces/wlr_keyboard.h>
+#include <wlr/types/wlr_box.h>
+#include <wlr/types/wlr_input_device.h>
+#include <wlr/types/wlr_output.h>
+#include <wlr/types/wlr_output_layout.h>
+#include <wlr/types/wlr_pointer.h>
+#include <wlr/util/log.h>
+
+#undef static
+}
+
+#include "bench_client.h"
+#include "output.h"
+#include "server.h"
+#include "view.h"
+
+// Linux input event codes, see linux/input-event-codes.h.
+static const uint32_t BENCH_BTN_LEFT = 0x110;
+static const uint32_t BENCH_KEY_A = 30;
+
+static const int BENCH_WARMUP_MSEC = 1000;
+
+struct Bench;
+
+struct BenchOutput {
+    Bench *bench;
+    Output *output;
+    std::vector<int> frame_usec;
+    int frames_skipped;
+    wl_listener repaint;
+};
+
+struct Bench {
+    Server *server;
+    int duration_msec;
+    // Pointer events per second.
+    int input_rate;
+
+    std::vector<BenchOutput*> outputs;
+    std::vector<pid_t> clients;
+    wlr_input_device *pointer;
+    wlr_input_device *keyboard;
+    wl_event_source *input_timer;
+    wl_event_source *start_timer;
+    wl_event_source *stop_timer;
+
+    int64_t start_msec;
+    uint64_t input_events;
+    int mapped_views;
+    double pointer_x, pointer_y;
+
+    bool measuring;
+    timespec measure_start;
+    rusage usage_start;
+    uint64_t commits_start;
+    double measured_sec;
+    double cpu_sec;
+    uint64_t commits;
+};
+
+static int64_t timespec_to_msec(const timespec *t) {
+    return t->tv_sec * 1000LL + t->tv_nsec / 1000000;
+}
+
+static int64_t now_msec() {
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return timespec_to_msec(&now);
+}
+
+static double timeval_to_sec(const timeval *t) {
+    return t->tv_sec + t->tv_usec / 1e6;
+}
+
+static void bench_output_repaint(wl_listener *listener, void *data) {
+    BenchOutput *bench_output = wl_container_of(listener, bench_output, repaint);
+    auto event = reinterpret_cast<OutputRepaintEvent*>(data);
+    if (!bench_output->bench->measuring) {
+        return;
+    }
+    if (event->committed) {
+        bench_output->frame_usec.push_back(event->usec);
+    } else {
+        bench_output->frames_skipped++;
+    }
+}
+
+// Spreads the windows over the whole layout, so that every output gets
+// some and they partially overlap each other.
+static void bench_arrange_views(Bench *bench) {
+    wlr_box *layout = wlr_output_layout_get_box(bench->server->output_layout, NULL);
+    if (layout == NULL || bench->mapped_views == 0) {
+        return;
+    }
+    int step_x = layout->width / (bench->mapped_views + 1);
+    int step_y = layout->height / (bench->mapped_views + 1);
+    int i = 0;
+    View *view;
+    wl_list_for_each_reverse(view, &bench->server->views, link) {
+        if (!view->mapped) {
+            continue;
+        }
+        view_move(view, layout->x + i * step_x, layout->y + i * step_y);
+        i++;
+    }
+}
+
+static void bench_pointer_motion(Bench *bench, uint32_t time_msec) {
+    // A Lissajous curve covering most of the layout.
+    wlr_box *layout = wlr_output_layout_get_box(bench->server->output_layout, NULL);
+    if (layout == NULL) {
+        return;
+    }
+    double t = bench->input_events / 1000.0;
+    double x = layout->x + layout->width * (0.5 + 0.45 * sin(t * 1.3));
+    double y = layout->y + layout->height * (0.5 + 0.45 * sin(t * 1.7));
+
+    wlr_event_pointer_motion event;
+    event.device = bench->pointer;
+    event.time_msec = time_msec;
+    event.delta_x = event.unaccel_dx = x - bench->pointer_x;
+    event.delta_y = event.unaccel_dy = y - bench->pointer_y;
+    wl_signal_emit(&bench->pointer->pointer->events.motion, &event);
+    wl_signal_emit(&bench->pointer->pointer->events.frame, bench->pointer->pointer);
+    bench->pointer_x = x;
+    bench->pointer_y = y;
+}
+
+static void bench_pointer_click(Bench *bench, uint32_t time_msec) {
+    wlr_event_pointer_button event;
+    event.device = bench->pointer;
+    event.time_msec = time_msec;
+    event.button = BENCH_BTN_LEFT;
+    event.state = WLR_BUTTON_PRESSED;
+    wl_signal_emit(&bench->pointer->pointer->events.button, &event);
+    wl_signal_emit(&bench->pointer->pointer->events.frame, bench->pointer->pointer);
+    event.state = WLR_BUTTON_RELEASED;
+    wl_signal_emit(&bench->pointer->pointer->events.button, &event);
+    wl_signal_emit(&bench->pointer->pointer->events.frame, bench->pointer->pointer);
+}
+
+static void bench_key_press(Bench *bench, uint32_t time_msec) {
+    wlr_event_keyboard_key event;
+    event.time_msec = time_msec;
+    event.keycode = BENCH_KEY_A;
+    event.update_state = true;
+    event.state = WLR_KEY_PRESSED;
+    wlr_keyboard_notify_key(bench->keyboard->keyboard, &event);
+    event.state = WLR_KEY_RELEASED;
+    wlr_keyboard_notify_key(bench->keyboard->keyboard, &event);
+}
+
+// Runs every millisecond, replaying the input script: the pointer keeps
+// moving at input_rate events per second, clicks once per second and a key
+// is typed ten times per second.
+static int bench_input_tick(void *data) {
+    auto bench = reinterpret_cast<Bench*>(data);
+    int64_t now = now_msec();
+    uint32_t time_msec = now;
+
+    int mapped_views = 0;
+    View *view;
+    wl_list_for_each(view, &bench->server->views, link) {
+        if (view->mapped) {
+            mapped_views++;
+        }
+    }
+    if (mapped_views != bench->mapped_views) {
+        bench->mapped_views = mapped_views;
+        bench_arrange_views(bench);
+    }
+
+    uint64_t due = (now - bench->start_msec) * bench->input_rate / 1000;
+    while (bench->input_events < due) {
+        bench_pointer_motion(bench, time_msec);
+        bench->input_events++;
+        if (bench->input_events % bench->input_rate == 0) {
+            bench_pointer_click(bench, time_msec);
+        }
+        if (bench->input_events % (bench->input_rate / 10 + 1) == 0) {
+            bench_key_press(bench, time_msec);
+        }
+    }
+
+    wl_event_source_timer_update(bench->input_timer, 1);
+    return 0;
+}
+
+static int bench_start_measuring(void *data) {
+    auto bench = reinterpret_cast<Bench*>(data);
+    bench->measuring = true;
+    clock_gettime(CLOCK_MONOTONIC, &bench->measure_start);
+    getrusage(RUSAGE_SELF, &bench->usage_start);
+    bench->commits_start = bench->server->surface_commits;
+    return 0;
+}
+
+static int bench_stop(void *data) {
+    auto bench = reinterpret_cast<Bench*>(data);
+    timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+
+    bench->measuring = false;
+    bench->measured_sec = (timespec_to_msec(&end) - timespec_to_msec(&bench->measure_start)) / 1000.0;
+    bench->cpu_sec =
+        timeval_to_sec(&usage.ru_utime) - timeval_to_sec(&bench->usage_start.ru_utime) +
+        timeval_to_sec(&usage.ru_stime) - timeval_to_sec(&bench->usage_start.ru_stime);
+    bench->commits = bench->server->surface_commits - bench->commits_start;
+    wl_display_terminate(bench->server->display);
+    return 0;
+}
+
+static int percentile(const std::vector<int> &sorted, int p) {
+    if (sorted.empty()) {
+        return 0;
+    }
+    size_t i = (sorted.size() - 1) * p / 100;
+    return sorted[i];
+}
+
+static void bench_report(Bench *bench) {
+    printf("%-12s %8s %8s %8s %8s %8s %8s %8s\n",
+           "output", "frames", "skipped", "p50 us", "p90 us", "p99 us", "max us", "fps");
+    size_t frames = 0;
+    for (BenchOutput *bench_output : bench->outputs) {
+        std::vector<int> &samples = bench_output->frame_usec;
+        std::sort(samples.begin(), samples.end());
+        frames += samples.size();
+        printf("%-12s %8zu %8d %8d %8d %8d %8d %8.1f\n",
+               bench_output->output->output->name,
+               samples.size(),
+               bench_output->frames_skipped,
+               percentile(samples, 50),
+               percentile(samples, 90),
+               percentile(samples, 99),
+               samples.empty() ? 0 : samples.back(),
+               samples.size() / bench->measured_sec);
+    }
+    printf("\n");
+    printf("duration:        %.2f s\n", bench->measured_sec);
+    printf("commits/s:       %.1f\n", bench->commits / bench->measured_sec);
+    printf("cpu:             %.1f%%\n", 100 * bench->cpu_sec / bench->measured_sec);
+    printf("cpu per frame:   %.1f us\n", frames > 0 ? 1e6 * bench->cpu_sec / frames : 0.0);
+}
+
+static void usage(const char *name) {
+    printf("Usage: %s [-o outputs] [-m output WxH] [-n windows] [-b buffer WxH]\n"
+           "       [-r commit rate] [-d subsurface depth] [-i input rate]\n"
+           "       [-t seconds] [-a] [-c software render threads]\n", name);
+}
+
+int main(int argc, char *argv[]) {
+    wlr_log_init(WLR_ERROR, NULL);
+    int output_count = 1;
+    int output_width = 1920, output_height = 1080;
+    int window_count = 8;
+    int duration = 10;
+    int input_rate = 1000;
+    ServerConfig server_config;
+    server_config_init(&server_config);
+    BenchClientConfig client_config;
+    client_config.width = 800;
+    client_config.height = 600;
+    client_config.commit_rate = 60;
+    client_config.subsurface_depth = 0;
+    client_config.opaque = true;
+
+    int c;
+    while ((c = getopt(argc, argv, "o:m:n:b:r:d:i:t:ac:h")) != -1) {
+        switch (c) {
+        case 'o':
+            output_count = atoi(optarg);
+            break;
+        case 'm':
+            if (sscanf(optarg, "%dx%d", &output_width, &output_height) != 2) {
+                usage(argv[0]);
+                return 1;
+            }
+            break;
+        case 'n':
+            window_count = atoi(optarg);
+            break;
+        case 'b':
+            if (sscanf(optarg, "%dx%d", &client_config.width, &client_config.height) != 2) {
+                usage(argv[0]);
+                return 1;
+            }
+            break;
+        case 'r':
+            client_config.commit_rate = atoi(optarg);
+            break;
+        case 'd':
+            client_config.subsurface_depth = atoi(optarg);
+            break;
+        case 'i':
+            input_rate = atoi(optarg);
+            break;
+        case 't':
+            duration = atoi(optarg);
+            break;
+        case 'a':
+            client_config.opaque = false;
+            break;
+        case 'c':
+            server_config.software_threads = atoi(optarg);
+            if (server_config.software_threads < 0) {
+                server_config.software_threads = 0;
+            }
+            break;
+        default:
+            usage(argv[0]);
+            return 0;
+        }
+    }
+    if (optind < argc || output_count < 1 || window_count < 0 || duration < 1 ||
+        input_rate < 1 || client_config.subsurface_depth < 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    Server server;
+    server_config.headless = true;
+    // bench_arrange_views places the windows so that they overlap.
+    server_config.tiling = false;
+    if (!server_init(&server, &server_config)) {
+        return 1;
+    }
+
+    Bench bench {};
+    bench.server = &server;
+    bench.duration_msec = duration * 1000;
+    bench.input_rate = input_rate;
+
+    for (int i = 0; i < output_count; i++) {
+        wlr_headless_add_output(server.backend, output_width, output_height);
+    }
+    Output *output;
+    wl_list_for_each_reverse(output, &server.outputs, link) {
+        BenchOutput *bench_output = new BenchOutput;
+        bench_output->bench = &bench;
+        bench_output->output = output;
+        bench_output->frames_skipped = 0;
+        bench_output->repaint.notify = bench_output_repaint;
+        wl_signal_add(&output->events.repaint, &bench_output->repaint);
+        bench.outputs.push_back(bench_output);
+    }
+    bench.pointer = wlr_headless_add_input_device(server.backend, WLR_INPUT_DEVICE_POINTER);
+    bench.keyboard = wlr_headless_add_input_device(server.backend, WLR_INPUT_DEVICE_KEYBOARD);
+    if (bench.pointer == NULL || bench.keyboard == NULL) {
+        fprintf(stderr, "failed to create input devices\n");
+        server_finish(&server);
+        return 1;
+    }
+
+    const char *socket = getenv("WAYLAND_DISPLAY");
+    for (int i = 0; i < window_count; i++) {
+        pid_t child = fork();
+        if (child == 0) {
+            // Unblocks the signals the event loop handles, SIGTERM among
+            // them.
+            sigset_t mask;
+            sigemptyset(&mask);
+            sigprocmask(SIG_SETMASK, &mask, NULL);
+            _exit(bench_client_run(socket, &client_config));
+        } else if (child < 0) {
+            fprintf(stderr, "failed to fork client process\n");
+            break;
+        }
+        bench.clients.push_back(child);
+    }
+
+    wl_event_loop *loop = wl_display_get_event_loop(server.display);
+    bench.start_msec = now_msec();
+    bench.input_timer = wl_event_loop_add_timer(loop, bench_input_tick, &bench);
+    wl_event_source_timer_update(bench.input_timer, 1);
+    bench.start_timer = wl_event_loop_add_timer(loop, bench_start_measuring, &bench);
+    wl_event_source_timer_update(bench.start_timer, BENCH_WARMUP_MSEC);
+    bench.stop_timer = wl_event_loop_add_timer(loop, bench_stop, &bench);
+    wl_event_source_timer_update(bench.stop_timer, BENCH_WARMUP_MSEC + bench.duration_msec);
+
+    wl_display_run(server.display);
+
+    bench_report(&bench);
+
+    wl_event_source_remove(bench.input_timer);
+    wl_event_source_remove(bench.start_timer);
+    wl_event_source_remove(bench.stop_timer);
+    for (BenchOutput *bench_output : bench.outputs) {
+        wl_list_remove(&bench_output->repaint.link);
+        delete bench_output;
+    }
+    server_finish(&server);
+    for (pid_t child : bench.clients) {
+        // Clients exit once the compositor goes away, this only makes
+        // sure they're not left stuck somewhere.
+        kill(child, SIGTERM);
+        waitpid(child, NULL, 0);
+    }
+    return 0;
+}
@@ -0,0 +1,332 @@
+// Copyright © 2020 Mateus Carmo Martins de Freitas Barbosa
+//
+// This program is licensed under the GNU General Public License, version 3.
+// See LICENSE.txt.
+//
+
+#include <errno.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+#include <wayland-client.h>
+
+#include "bench_client.h"
+#include "xdg-shell-client-protocol.h"
+
+static const int SUBSURFACE_OFFSET = 16;
+
+struct BenchBuffer {
+    wl_buffer *buffer;
+    uint32_t *data;
+    size_t size;
+    bool busy;
+};
+
+struct BenchSurface {
+    wl_surface *surface;
+    wl_subsurface *subsurface;
+    int width, height;
+    BenchBuffer buffers[2];
+};
+
+struct BenchClient {
+    const BenchClientConfig *config;
+    wl_display *display;
+    wl_registry *registry;
+    wl_compositor *compositor;
+    wl_subcompositor *subcompositor;
+    wl_shm *shm;
+    xdg_wm_base *wm_base;
+    xdg_surface *_xdg_surface;
+    xdg_toplevel *toplevel;
+    // The toplevel first, then each subsurface on top of the previous one.
+    std::vector<BenchSurface> surfaces;
+    bool configured;
+    bool running;
+    uint32_t frame;
+};
+
+static int64_t now_msec() {
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000LL + now.tv_nsec / 1000000;
+}
+
+static void registry_global(void *data,
+                            wl_registry *registry,
+                            uint32_t name,
+                            const char *interface,
+                            uint32_t version) {
+    auto client = reinterpret_cast<BenchClient*>(data);
+    if (strcmp(interface, wl_compositor_interface.name) == 0) {
+        client->compositor = reinterpret_cast<wl_compositor*>(
+            wl_registry_bind(registry, name, &wl_compositor_interface, 4)
+        );
+    } else if (strcmp(interface, wl_subcompositor_interface.name) == 0) {
+        client->subcompositor = reinterpret_cast<wl_subcompositor*>(
+            wl_registry_bind(registry, name, &wl_subcompositor_interface, 1)
+        );
+    } else if (strcmp(interface, wl_shm_interface.name) == 0) {
+        client->shm = reinterpret_cast<wl_shm*>(
+            wl_registry_bind(registry, name, &wl_shm_interface, 1)
+        );
+    } else if (strcmp(interface, xdg_wm_base_interface.name) == 0) {
+        client->wm_base = reinterpret_cast<xdg_wm_base*>(
+            wl_registry_bind(registry, name, &xdg_wm_base_interface, 1)
+        );
+    }
+}
+
+static void registry_global_remove(void *data, wl_registry *registry, uint32_t name) {
+}
+
+static const wl_registry_listener registry_listener = {
+    registry_global,
+    registry_global_remove,
+};
+
+static void wm_base_ping(void *data, xdg_wm_base *wm_base, uint32_t serial) {
+    xdg_wm_base_pong(wm_base, serial);
+}
+
+static const xdg_wm_base_listener wm_base_listener = {
+    wm_base_ping,
+};
+
+static void xdg_surface_configure(void *data, xdg_surface *_xdg_surface, uint32_t serial) {
+    auto client = reinterpret_cast<BenchClient*>(data);
+    xdg_surface_ack_configure(_xdg_surface, serial);
+    client->configured = true;
+}
+
+static const xdg_surface_listener _xdg_surface_listener = {
+    xdg_surface_configure,
+};
+
+static void toplevel_configure(void *data,
+                               xdg_toplevel *toplevel,
+                               int32_t width, int32_t height,
+                               wl_array *states) {
+    // The buffer size is part of the benchmark, so it's not up to the
+    // compositor.
+}
+
+static void toplevel_close(void *data, xdg_toplevel *toplevel) {
+    auto client = reinterpret_cast<BenchClient*>(data);
+    client->running = false;
+}
+
+static const xdg_toplevel_listener toplevel_listener = {
+    toplevel_configure,
+    toplevel_close,
+};
+
+static void buffer_release(void *data, wl_buffer *buffer) {
+    auto bench_buffer = reinterpret_cast<BenchBuffer*>(data);
+    bench_buffer->busy = false;
+}
+
+static const wl_buffer_listener buffer_listener = {
+    buffer_release,
+};
+
+static bool create_buffer(BenchClient *client, BenchSurface *surface, BenchBuffer *buffer) {
+    int stride = surface->width * 4;
+    buffer->size = static_cast<size_t>(stride) * surface->height;
+    int fd = memfd_create("stacktile-bench", MFD_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    if (ftruncate(fd, buffer->size) < 0) {
+        close(fd);
+        return false;
+    }
+    void *data = mmap(NULL, buffer->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (data == MAP_FAILED) {
+        close(fd);
+        return false;
+    }
+
+    wl_shm_pool *pool = wl_shm_create_pool(client->shm, fd, buffer->size);
+    buffer->buffer = wl_shm_pool_create_buffer(
+        pool,
+        0,
+        surface->width,
+        surface->height,
+        stride,
+        client->config->opaque ? WL_SHM_FORMAT_XRGB8888 : WL_SHM_FORMAT_ARGB8888
+    );
+    wl_shm_pool_destroy(pool);
+    close(fd);
+
+    buffer->data = reinterpret_cast<uint32_t*>(data);
+    buffer->busy = false;
+    wl_buffer_add_listener(buffer->buffer, &buffer_listener, buffer);
+    return true;
+}
+
+static bool create_surfaces(BenchClient *client) {
+    const BenchClientConfig *config = client->config;
+    client->surfaces.resize(config->subsurface_depth + 1);
+
+    int width = config->width, height = config->height;
+    for (size_t i = 0; i < client->surfaces.size(); i++) {
+        BenchSurface *surface = &client->surfaces[i];
+        surface->surface = wl_compositor_create_surface(client->compositor);
+        surface->subsurface = NULL;
+        surface->width = width > 1 ? width : 1;
+        surface->height = height > 1 ? height : 1;
+        if (i > 0) {
+            surface->subsurface = wl_subcompositor_get_subsurface(
+                client->subcompositor,
+                surface->surface,
+                client->surfaces[i - 1].surface
+            );
+            wl_subsurface_set_position(surface->subsurface, SUBSURFACE_OFFSET, SUBSURFACE_OFFSET);
+        }
+        if (config->opaque) {
+            wl_region *region = wl_compositor_create_region(client->compositor);
+            wl_region_add(region, 0, 0, surface->width, surface->height);
+            wl_surface_set_opaque_region(surface->surface, region);
+            wl_region_destroy(region);
+        }
+        for (BenchBuffer &buffer : surface->buffers) {
+            if (!create_buffer(client, surface, &buffer)) {
+                return false;
+            }
+        }
+        width -= 2 * SUBSURFACE_OFFSET;
+        height -= 2 * SUBSURFACE_OFFSET;
+    }
+
+    client->_xdg_surface = xdg_wm_base_get_xdg_surface(client->wm_base, client->surfaces[0].surface);
+    xdg_surface_add_listener(client->_xdg_surface, &_xdg_surface_listener, client);
+    client->toplevel = xdg_surface_get_toplevel(client->_xdg_surface);
+    xdg_toplevel_add_listener(client->toplevel, &toplevel_listener, client);
+    xdg_toplevel_set_title(client->toplevel, "stacktile-bench");
+    wl_surface_commit(client->surfaces[0].surface);
+    return true;
+}
+
+static void draw_surface(BenchClient *client, BenchSurface *surface, size_t depth) {
+    BenchBuffer *buffer = NULL;
+    for (BenchBuffer &candidate : surface->buffers) {
+        if (!candidate.busy) {
+            buffer = &candidate;
+            break;
+        }
+    }
+    if (buffer == NULL) {
+        // The compositor is still holding both buffers, skip this one.
+        return;
+    }
+
+    // Pre-multiplied, half transparent unless opaque.
+    uint32_t shade = (client->frame * 4 + depth * 32) & 0x7f;
+    uint32_t pixel = 0x80000000 | shade << 16 | (0x7f - shade) << 8 | 0x40;
+    if (client->config->opaque) {
+        pixel |= 0xff000000;
+    }
+    size_t count = buffer->size / 4;
+    for (size_t i = 0; i < count; i++) {
+        buffer->data[i] = pixel;
+    }
+
+    wl_surface_attach(surface->surface, buffer->buffer, 0, 0);
+    wl_surface_damage_buffer(surface->surface, 0, 0, surface->width, surface->height);
+    buffer->busy = true;
+}
+
+static void commit_frame(BenchClient *client) {
+    // Subsurfaces are synchronized, so their state is applied together
+    // with the toplevel's, which is committed last.
+    for (size_t i = client->surfaces.size(); i-- > 0;) {
+        BenchSurface *surface = &client->surfaces[i];
+        draw_surface(client, surface, i);
+        wl_surface_commit(surface->surface);
+    }
+    client->frame++;
+}
+
+int bench_client_run(const char *socket, const BenchClientConfig *config) {
+    BenchClient client {};
+    client.config = config;
+    client.display = wl_display_connect(socket);
+    if (client.display == NULL) {
+        fprintf(stderr, "bench client: failed to connect to %s\n", socket);
+        return 1;
+    }
+    client.registry = wl_display_get_registry(client.display);
+    wl_registry_add_listener(client.registry, &registry_listener, &client);
+    wl_display_roundtrip(client.display);
+    if (client.compositor == NULL || client.subcompositor == NULL ||
+        client.shm == NULL || client.wm_base == NULL) {
+        fprintf(stderr, "bench client: missing globals\n");
+        wl_display_disconnect(client.display);
+        return 1;
+    }
+    xdg_wm_base_add_listener(client.wm_base, &wm_base_listener, &client);
+    if (!create_surfaces(&client)) {
+        fprintf(stderr, "bench client: failed to create buffers: %s\n", strerror(errno));
+        wl_display_disconnect(client.display);
+        return 1;
+    }
+
+    int period = config->commit_rate > 0 ? 1000 / config->commit_rate : -1;
+    if (period == 0) {
+        period = 1;
+    }
+    int64_t next_commit = now_msec();
+    client.running = true;
+    while (client.running) {
+        while (wl_display_prepare_read(client.display) != 0) {
+            if (wl_display_dispatch_pending(client.display) < 0) {
+                client.running = false;
+                break;
+            }
+        }
+        if (!client.running) {
+            break;
+        }
+        if (wl_display_flush(client.display) < 0 && errno != EAGAIN) {
+            wl_display_cancel_read(client.display);
+            break;
+        }
+
+        int timeout = -1;
+        if (client.configured && period > 0) {
+            int64_t wait = next_commit - now_msec();
+            timeout = wait > 0 ? wait : 0;
+        }
+        pollfd pfd = { wl_display_get_fd(client.display), POLLIN, 0 };
+        if (poll(&pfd, 1, timeout) > 0) {
+            if (wl_display_read_events(client.display) < 0) {
+                break;
+            }
+        } else {
+            wl_display_cancel_read(client.display);
+        }
+        if (wl_display_dispatch_pending(client.display) < 0) {
+            break;
+        }
+
+        // Without a commit rate the window is drawn once, just to map it.
+        bool due = client.frame == 0 || (period > 0 && now_msec() >= next_commit);
+        if (client.configured && due) {
+            commit_frame(&client);
+            next_commit += period;
+            if (next_commit < now_msec()) {
+                // Don't try to catch up after falling behind.
+                next_commit = now_msec() + period;
+            }
+        }
+    }
+
+    wl_display_disconnect(client.display);
+    return 0;
+}
@@ -0,0 +1,27 @@
+// Copyright © 2020 Mateus Carmo Martins de Freitas Barbosa
+//
+// This program is licensed under the GNU General Public License, version 3.
+// See LICENSE.txt.
+//
+
+#ifndef STACKTILE_BENCH_CLIENT_H
+#define STACKTILE_BENCH_CLIENT_H
+
+struct BenchClientConfig {
+    // Size of the toplevel's buffer. Every subsurface is a bit smaller
+    // than its parent.
+    int width, height;
+    // New buffers per second on every surface of the window.
+    int commit_rate;
+    // How many subsurfaces are nested under the toplevel.
+    int subsurface_depth;
+    // Opaque windows use XRGB buffers and set their opaque region.
+    bool opaque;
+};
+
+// Maps a single xdg toplevel on the compositor listening on socket and
+// redraws it until the compositor goes away. Returns the exit status for
+// the client process.
+int bench_client_run(const char *socket, const BenchClientConfig *config);
+
+#endif /* STACKTILE_BENCH_CLIENT_H */
@@ -0,0 +1,118 @@
+// Copyright © 2020 Mateus Carmo Martins de Freitas Barbosa
+//
+// This program is licensed under the GNU General Public License, version 3.
+// See LICENSE.txt.
+//
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "blend.h"
+
+// x / 255 for x in [0, 255 * 255], rounded.
+static inline uint32_t div255(uint32_t x) {
+    x += 128;
+    return (x + (x >> 8)) >> 8;
+}
+
+static inline uint32_t over_pixel(uint32_t dst, uint32_t src) {
+    uint32_t inv = 255 - (src >> 24);
+    if (inv == 0) {
+        return src;
+    }
+    uint32_t rb = (dst & 0x00ff00ff) * inv;
+    uint32_t ag = ((dst >> 8) & 0x00ff00ff) * inv;
+    // Both channels of each pair are divided at once.
+    rb = ((rb + 0x00800080 + ((rb >> 8) & 0x00ff00ff)) >> 8) & 0x00ff00ff;
+    ag = (ag + 0x00800080 + ((ag >> 8) & 0x00ff00ff)) & 0xff00ff00;
+    return src + (rb | ag);
+}
+
+void blend_fill(uint32_t *dst, int count, uint32_t color) {
+    int i = 0;
+#ifdef __SSE2__
+    __m128i c = _mm_set1_epi32(color);
+    for (; i + 4 <= count; i += 4) {
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), c);
+    }
+#endif
+    for (; i < count; i++) {
+        dst[i] = color;
+    }
+}
+
+void blend_copy_opaque(uint32_t *dst, const uint32_t *src, int count) {
+    int i = 0;
+#ifdef __SSE2__
+    __m128i alpha = _mm_set1_epi32(0xff000000);
+    for (; i + 4 <= count; i += 4) {
+        __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_or_si128(s, alpha));
+    }
+#endif
+    for (; i < count; i++) {
+        dst[i] = src[i] | 0xff000000;
+    }
+}
+
+#ifdef __SSE2__
+// Four pixels at a time, each channel widened to 16 bits.
+static inline __m128i over_sse2(__m128i d, __m128i s) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i ff = _mm_set1_epi16(255);
+    const __m128i round = _mm_set1_epi16(128);
+
+    // Broadcast every pixel's inverted alpha to its four channels.
+    __m128i alpha = _mm_srli_epi32(s, 24);
+    alpha = _mm_or_si128(alpha, _mm_slli_epi32(alpha, 16));
+
+    __m128i alpha_lo = _mm_unpacklo_epi32(alpha, alpha);
+    __m128i alpha_hi = _mm_unpackhi_epi32(alpha, alpha);
+    __m128i inv_lo = _mm_sub_epi16(ff, alpha_lo);
+    __m128i inv_hi = _mm_sub_epi16(ff, alpha_hi);
+
+    __m128i d_lo = _mm_unpacklo_epi8(d, zero);
+    __m128i d_hi = _mm_unpackhi_epi8(d, zero);
+    d_lo = _mm_add_epi16(_mm_mullo_epi16(d_lo, inv_lo), round);
+    d_hi = _mm_add_epi16(_mm_mullo_epi16(d_hi, inv_hi), round);
+    d_lo = _mm_srli_epi16(_mm_add_epi16(d_lo, _mm_srli_epi16(d_lo, 8)), 8);
+    d_hi = _mm_srli_epi16(_mm_add_epi16(d_hi, _mm_srli_epi16(d_hi, 8)), 8);
+
+    return _mm_add_epi8(s, _mm_packus_epi16(d_lo, d_hi));
+}
+#endif
+
+void blend_over(uint32_t *dst, const uint32_t *src, int count) {
+    int i = 0;
+#ifdef __SSE2__
+    for (; i + 4 <= count; i += 4) {
+        __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        __m128i alpha = _mm_srli_epi32(s, 24);
+        __m128i opaque = _mm_cmpeq_epi32(alpha, _mm_set1_epi32(255));
+        if (_mm_movemask_epi8(opaque) == 0xffff) {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), s);
+            continue;
+        }
+        if (_mm_movemask_epi8(_mm_cmpeq_epi32(s, _mm_setzero_si128())) == 0xffff) {
+            // Fully transparent.
+            continue;
+        }
+        __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), over_sse2(d, s));
+    }
+#endif
+    for (; i < count; i++) {
+        dst[i] = over_pixel(dst[i], src[i]);
+    }
+}
+
+void blend_over_alpha(uint32_t *dst, const uint32_t *src, int count, uint32_t alpha) {
+    for (int i = 0; i < count; i++) {
+        uint32_t rb = (src[i] & 0x00ff00ff) * alpha;
+        uint32_t ag = ((src[i] >> 8) & 0x00ff00ff) * alpha;
+        rb = ((rb + 0x00800080 + ((rb >> 8) & 0x00ff00ff)) >> 8) & 0x00ff00ff;
+        ag = (ag + 0x00800080 + ((ag >> 8) & 0x00ff00ff)) & 0xff00ff00;
+        dst[i] = over_pixel(dst[i], rb | ag);
+    }
+}
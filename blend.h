@@ -0,0 +1,24 @@
+// Copyright © 2020 Mateus Carmo Martins de Freitas Barbosa
+//
+// This program is licensed under the GNU General Public License, version 3.
+// See LICENSE.txt.
+//
+
+#ifndef STACKTILE_BLEND_H
+#define STACKTILE_BLEND_H
+
+#include <stdint.h>
+
+// Pixel kernels for software composition, on rows of pre-multiplied
+// ARGB8888 pixels. They use SSE2 when the compiler targets it, which every
+// x86-64 build does, and plain C otherwise.
+
+void blend_fill(uint32_t *dst, int count, uint32_t color);
+// Copies pixels whose alpha channel is undefined (XRGB8888) as opaque.
+void blend_copy_opaque(uint32_t *dst, const uint32_t *src, int count);
+// Source over destination.
+void blend_over(uint32_t *dst, const uint32_t *src, int count);
+// Source scaled by alpha, in [0, 255], over destination.
+void blend_over_alpha(uint32_t *dst, const uint32_t *src, int count, uint32_t alpha);
+
+#endif /* STACKTILE_BLEND_H */
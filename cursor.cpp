@@ -10,6 +10,7 @@ extern "C" {
 #define static
 
 #include <wlr/types/wlr_cursor.h>
+#include <wlr/types/wlr_output.h>
 #include <wlr/types/wlr_seat.h>
 #include <wlr/types/wlr_xcursor_manager.h>
 #include <wlr/types/wlr_xdg_shell.h>
@@ -18,7 +19,13 @@ extern "C" {
 }
 
 #include "cursor.h"
+#include "geometry.h"
+#include "idle.h"
+#include "output.h"
 #include "server.h"
+#include "stats.h"
+#include "trace.h"
+#include "transaction.h"
 #include "view.h"
 
 void handle_new_pointer(Server *server,
@@ -29,6 +36,9 @@ void handle_new_pointer(Server *server,
 void handle_cursor_axis(wl_listener *listener, void *data) {
     Server *server = wl_container_of(listener, server, cursor_axis);
     auto event = reinterpret_cast<wlr_event_pointer_axis*>(data);
+    idle_notify_activity(server);
+    // Scrolling goes to whatever is under the pointer now.
+    cursor_flush_motion(server);
     wlr_seat_pointer_notify_axis(
         server->seat,
         event->time_msec,
@@ -37,65 +47,58 @@ void handle_cursor_axis(wl_listener *listener, void *data) {
         event->delta_discrete,
         event->source
     );
+    stats_input_handled(server, event->time_msec, server->seat->pointer_state.focused_surface);
 }
 
 void handle_cursor_frame(wl_listener *listener, void *data) {
     Server *server = wl_container_of(listener, server, cursor_frame);
+    if (server->cursor_mode == STACKTILE_CURSOR_PASSTHROUGH) {
+        cursor_flush_motion(server);
+    } else if (server->motion_pending) {
+        // Grabs only need to follow the pointer once per output refresh,
+        // so the motion is processed by the next repaint.
+        Output *output;
+        wl_list_for_each(output, &server->outputs, link) {
+            wlr_output_schedule_frame(output->output);
+        }
+    }
     wlr_seat_pointer_notify_frame(server->seat);
 }
 
 static void process_cursor_move(Server *server, uint32_t time) {
-    server->grabbed_view->x = server->cursor->x - server->grab_x;
-    server->grabbed_view->y = server->cursor->y - server->grab_y;
+    view_move(
+        server->grabbed_view,
+        server->cursor->x - server->grab_x,
+        server->cursor->y - server->grab_y
+    );
 }
 
 static void process_cursor_resize(Server *server, uint32_t time) {
-    // In a more fleshed-out compositor,
-    // you'd wait for the client to prepare a buffer at the new size, then
-    // commit any movement that was prepared.
+    // The new geometry goes through a transaction, so the view only moves
+    // once the client has a buffer at the new size. Motion that happens
+    // meanwhile just updates the next configure.
     //
     View *view = server->grabbed_view;
-    double border_x = server->cursor->x - server->grab_x;
-    double border_y = server->cursor->y - server->grab_y;
-    int new_left = server->grab_geobox.x;
-    int new_right = server->grab_geobox.x + server->grab_geobox.width;
-    int new_top = server->grab_geobox.y;
-    int new_bottom = server->grab_geobox.y + server->grab_geobox.height;
-
-    if (server->resize_edges & WLR_EDGE_TOP) {
-        new_top = border_y;
-        if (new_top >= new_bottom) {
-            new_top = new_bottom - 1;
-        }
-    } else if (server->resize_edges & WLR_EDGE_BOTTOM) {
-        new_bottom = border_y;
-        if (new_bottom <= new_top) {
-            new_bottom = new_top + 1;
-        }
-    }
-    if (server->resize_edges & WLR_EDGE_LEFT) {
-        new_left = border_x;
-        if (new_left >= new_right) {
-            new_left = new_right - 1;
-        }
-    } else if (server->resize_edges & WLR_EDGE_RIGHT) {
-        new_right = border_x;
-        if (new_right <= new_left) {
-            new_right = new_left + 1;
-        }
-    }
-
-    wlr_box geo_box;
-    wlr_xdg_surface_get_geometry(view->xdg_surface, &geo_box);
-    view->x = new_left - geo_box.x;
-    view->y = new_top - geo_box.y;
+    Box grab {
+        server->grab_geobox.x,
+        server->grab_geobox.y,
+        server->grab_geobox.width,
+        server->grab_geobox.height,
+    };
+    Box resized = box_resize(
+        &grab,
+        server->resize_edges,
+        server->cursor->x - server->grab_x,
+        server->cursor->y - server->grab_y
+    );
 
-    int new_width = new_right - new_left;
-    int new_height = new_bottom - new_top;
-    wlr_xdg_toplevel_set_size(view->xdg_surface, new_width, new_height);
+    wlr_box geometry { resized.x, resized.y, resized.width, resized.height };
+    view_configure(view, &geometry);
+    transaction_commit_dirty(server);
 }
 
 static void process_cursor_motion(Server *server, uint32_t time) {
+    TRACE_SCOPE("process_cursor_motion");
     if (server->cursor_mode == STACKTILE_CURSOR_MOVE) {
         process_cursor_move(server, time);
         return;
@@ -115,9 +118,10 @@ static void process_cursor_motion(Server *server, uint32_t time) {
         &sx,
         &sy
     );
-    if (!view) {
+    if (!view && server->cursor_image != CURSOR_IMAGE_DEFAULT) {
         wlr_xcursor_manager_set_cursor_image(
-                server->cursor_mgr, "left_ptr", server->cursor);
+                server->cursor_mgr, CURSOR_IMAGE_DEFAULT, server->cursor);
+        server->cursor_image = CURSOR_IMAGE_DEFAULT;
     }
     if (surface) {
         bool focus_changed = seat->pointer_state.focused_surface != surface;
@@ -130,9 +134,35 @@ static void process_cursor_motion(Server *server, uint32_t time) {
     }
 }
 
+void cursor_flush_motion(Server *server) {
+    if (!server->motion_pending) {
+        return;
+    }
+    server->motion_pending = false;
+    process_cursor_motion(server, server->motion_time);
+    // Grabs move views around themselves, without a client to wait on.
+    wlr_surface *target = NULL;
+    if (server->cursor_mode == STACKTILE_CURSOR_PASSTHROUGH) {
+        target = server->seat->pointer_state.focused_surface;
+    }
+    stats_input_handled(server, server->motion_first_time, target);
+}
+
+// Motion events only move the cursor. Hit-testing, focus and the events
+// sent to clients are dealt with once per pointer frame, with the latest
+// position, since wl_pointer.motion carries absolute coordinates anyway.
+static void queue_cursor_motion(Server *server, uint32_t time) {
+    if (!server->motion_pending) {
+        server->motion_first_time = time;
+    }
+    server->motion_pending = true;
+    server->motion_time = time;
+}
+
 void handle_cursor_motion(wl_listener *listener, void *data) {
     Server *server = wl_container_of(listener, server, cursor_motion);
     auto event = reinterpret_cast<wlr_event_pointer_motion*>(data);
+    idle_notify_activity(server);
 
     wlr_cursor_move(
         server->cursor,
@@ -140,7 +170,7 @@ void handle_cursor_motion(wl_listener *listener, void *data) {
         event->delta_x,
         event->delta_y
     );
-    process_cursor_motion(server, event->time_msec);
+    queue_cursor_motion(server, event->time_msec);
 }
 
 void handle_cursor_motion_absolute(wl_listener *listener, void *data) {
@@ -153,21 +183,26 @@ void handle_cursor_motion_absolute(wl_listener *listener, void *data) {
     //
     Server *server = wl_container_of(listener, server, cursor_motion_absolute);
     auto event = reinterpret_cast<wlr_event_pointer_motion_absolute*>(data);
+    idle_notify_activity(server);
 
     wlr_cursor_warp_absolute(server->cursor, event->device, event->x, event->y);
-    process_cursor_motion(server, event->time_msec);
+    queue_cursor_motion(server, event->time_msec);
 }
 
 void handle_cursor_button(wl_listener *listener, void *data) {
     Server *server = wl_container_of(listener, server, cursor_button);
     auto event = reinterpret_cast<wlr_event_pointer_button*>(data);
+    idle_notify_activity(server);
 
+    // Grabs and focus must see where the pointer is now.
+    cursor_flush_motion(server);
     wlr_seat_pointer_notify_button(
         server->seat,
         event->time_msec,
         event->button,
         event->state
     );
+    wlr_surface *target = server->seat->pointer_state.focused_surface;
     double sx, sy;
     wlr_surface *surface;
     View *view = desktop_view_at(
@@ -183,4 +218,5 @@ void handle_cursor_button(wl_listener *listener, void *data) {
     } else {
         focus_view(view, surface);
     }
+    stats_input_handled(server, event->time_msec, target);
 }
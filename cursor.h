@@ -17,6 +17,11 @@ enum CursorMode {
     STACKTILE_CURSOR_RESIZE,
 };
 
+static const char *const CURSOR_IMAGE_DEFAULT = "left_ptr";
+
+// Processes the motion queued since the last pointer frame, if any.
+void cursor_flush_motion(Server *server);
+
 void handle_new_pointer(Server *server,
                         wlr_input_device *device);
 
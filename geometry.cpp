@@ -0,0 +1,81 @@
+// Copyright © 2020 Mateus Carmo Martins de Freitas Barbosa
+//
+// This program is licensed under the GNU General Public License, version 3.
+// See LICENSE.txt.
+//
+
+#include <stddef.h>
+#include <algorithm>
+
+#include "geometry.h"
+
+bool box_empty(const Box *box) {
+    return box == NULL || box->width <= 0 || box->height <= 0;
+}
+
+bool box_equal(const Box *a, const Box *b) {
+    return a->x == b->x && a->y == b->y &&
+        a->width == b->width && a->height == b->height;
+}
+
+bool box_contains_point(const Box *box, double x, double y) {
+    if (box_empty(box)) {
+        return false;
+    }
+    return x >= box->x && x < box->x + box->width &&
+        y >= box->y && y < box->y + box->height;
+}
+
+bool box_intersection(Box *dest, const Box *a, const Box *b) {
+    if (box_empty(a) || box_empty(b)) {
+        *dest = { 0, 0, 0, 0 };
+        return false;
+    }
+    int x1 = std::max(a->x, b->x);
+    int y1 = std::max(a->y, b->y);
+    int x2 = std::min(a->x + a->width, b->x + b->width);
+    int y2 = std::min(a->y + a->height, b->y + b->height);
+    if (x2 <= x1 || y2 <= y1) {
+        *dest = { 0, 0, 0, 0 };
+        return false;
+    }
+    *dest = { x1, y1, x2 - x1, y2 - y1 };
+    return true;
+}
+
+Box box_resize(const Box *grab, uint32_t edges, double border_x, double border_y) {
+    int new_left = grab->x;
+    int new_right = grab->x + grab->width;
+    int new_top = grab->y;
+    int new_bottom = grab->y + grab->height;
+
+    if (edges & EDGE_TOP) {
+        new_top = border_y;
+        if (new_top >= new_bottom) {
+            new_top = new_bottom - 1;
+        }
+    } else if (edges & EDGE_BOTTOM) {
+        new_bottom = border_y;
+        if (new_bottom <= new_top) {
+            new_bottom = new_top + 1;
+        }
+    }
+    if (edges & EDGE_LEFT) {
+        new_left = border_x;
+        if (new_left >= new_right) {
+            new_left = new_right - 1;
+        }
+    } else if (edges & EDGE_RIGHT) {
+        new_right = border_x;
+        if (new_right <= new_left) {
+            new_right = new_left + 1;
+        }
+    }
+
+    return {
+        new_left,
+        new_top,
+        new_right - new_left,
+        new_bottom - new_top,
+    };
+}
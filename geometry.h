@@ -0,0 +1,39 @@
+// Copyright © 2020 Mateus Carmo Martins de Freitas Barbosa
+//
+// This program is licensed under the GNU General Public License, version 3.
+// See LICENSE.txt.
+//
+
+#ifndef STACKTILE_GEOMETRY_H
+#define STACKTILE_GEOMETRY_H
+
+#include <stdint.h>
+
+// Part of the core library, which doesn't depend on wlroots. Box has the
+// same layout as wlr_box.
+struct Box {
+    int x, y;
+    int width, height;
+};
+
+// Same values as enum wlr_edges.
+enum Edges {
+    EDGE_NONE = 0,
+    EDGE_TOP = 1,
+    EDGE_BOTTOM = 2,
+    EDGE_LEFT = 4,
+    EDGE_RIGHT = 8,
+};
+
+bool box_empty(const Box *box);
+bool box_equal(const Box *a, const Box *b);
+bool box_contains_point(const Box *box, double x, double y);
+// Returns false, and an empty dest, if the boxes don't intersect.
+bool box_intersection(Box *dest, const Box *a, const Box *b);
+
+// Returns the box grabbed by the given edges after dragging them to
+// border_x and border_y. It never gets smaller than 1x1 and the opposite
+// edges stay in place.
+Box box_resize(const Box *grab, uint32_t edges, double border_x, double border_y);
+
+#endif /* STACKTILE_GEOMETRY_H */
@@ -0,0 +1,103 @@
+// Copyright © 2020 Mateus Carmo Martins de Freitas Barbosa
+//
+// This program is licensed under the GNU General Public License, version 3.
+// See LICENSE.txt.
+//
+
+#include <math.h>
+#include <algorithm>
+
+#include "grid.h"
+
+// Big enough that a maximized view only spans a few dozen cells.
+static const int CELL_SIZE = 256;
+
+static int cell_coord(double v) {
+    return static_cast<int>(floor(v / CELL_SIZE));
+}
+
+static uint64_t cell_key(int cx, int cy) {
+    return (static_cast<uint64_t>(static_cast<uint32_t>(cx)) << 32) |
+        static_cast<uint32_t>(cy);
+}
+
+template<typename F>
+static void for_each_cell(const Box *box, F f) {
+    if (box_empty(box)) {
+        return;
+    }
+    int x1 = cell_coord(box->x), x2 = cell_coord(box->x + box->width - 1);
+    int y1 = cell_coord(box->y), y2 = cell_coord(box->y + box->height - 1);
+    for (int cy = y1; cy <= y2; cy++) {
+        for (int cx = x1; cx <= x2; cx++) {
+            f(cell_key(cx, cy));
+        }
+    }
+}
+
+void grid_item_init(GridItem *item, void *data) {
+    item->box = { 0, 0, 0, 0 };
+    item->z = 0;
+    item->indexed = false;
+    item->data = data;
+}
+
+void grid_remove(Grid *grid, GridItem *item) {
+    if (!item->indexed) {
+        return;
+    }
+    for_each_cell(&item->box, [&](uint64_t key) {
+        auto cell = grid->cells.find(key);
+        if (cell == grid->cells.end()) {
+            return;
+        }
+        std::vector<GridItem*> &items = cell->second;
+        items.erase(std::remove(items.begin(), items.end(), item), items.end());
+        if (items.empty()) {
+            grid->cells.erase(cell);
+        }
+    });
+    item->indexed = false;
+}
+
+void grid_update(Grid *grid, GridItem *item, const Box *box, int64_t z) {
+    if (item->indexed && item->z == z && box_equal(&item->box, box)) {
+        return;
+    }
+    grid_remove(grid, item);
+
+    item->box = *box;
+    item->z = z;
+    item->indexed = true;
+    for_each_cell(box, [&](uint64_t key) {
+        std::vector<GridItem*> &items = grid->cells[key];
+        auto pos = std::upper_bound(
+            items.begin(),
+            items.end(),
+            item,
+            [](GridItem *a, GridItem *b) { return a->z > b->z; }
+        );
+        items.insert(pos, item);
+    });
+}
+
+const std::vector<GridItem*> *grid_items_at(const Grid *grid, double x, double y) {
+    auto cell = grid->cells.find(cell_key(cell_coord(x), cell_coord(y)));
+    if (cell == grid->cells.end()) {
+        return NULL;
+    }
+    return &cell->second;
+}
+
+GridItem *grid_item_at(const Grid *grid, double x, double y) {
+    const std::vector<GridItem*> *items = grid_items_at(grid, x, y);
+    if (items == NULL) {
+        return NULL;
+    }
+    for (GridItem *item : *items) {
+        if (box_contains_point(&item->box, x, y)) {
+            return item;
+        }
+    }
+    return NULL;
+}
@@ -0,0 +1,43 @@
+// Copyright © 2020 Mateus Carmo Martins de Freitas Barbosa
+//
+// This program is licensed under the GNU General Public License, version 3.
+// See LICENSE.txt.
+//
+
+#ifndef STACKTILE_GRID_H
+#define STACKTILE_GRID_H
+
+#include <stdint.h>
+#include <unordered_map>
+#include <vector>
+#include "geometry.h"
+
+// An entry in a Grid, embedded in whatever it indexes.
+struct GridItem {
+    // What the item was last indexed with.
+    Box box;
+    int64_t z;
+    bool indexed;
+    void *data;
+};
+
+// A uniform grid over layout coordinates. Every cell lists the items whose
+// box touches it, ordered from top to bottom, so a hit-test only looks at
+// the items around the point.
+struct Grid {
+    std::unordered_map<uint64_t, std::vector<GridItem*>> cells;
+};
+
+void grid_item_init(GridItem *item, void *data);
+
+// Indexes the item with the given box and stacking position, replacing
+// any previous entry.
+void grid_update(Grid *grid, GridItem *item, const Box *box, int64_t z);
+void grid_remove(Grid *grid, GridItem *item);
+
+// Returns the items whose box may contain the point, top first, or NULL.
+const std::vector<GridItem*> *grid_items_at(const Grid *grid, double x, double y);
+// Returns the topmost item whose box contains the point, or NULL.
+GridItem *grid_item_at(const Grid *grid, double x, double y);
+
+#endif /* STACKTILE_GRID_H */
@@ -0,0 +1,62 @@
+// Copyright © 2020 Mateus Carmo Martins de Freitas Barbosa
+//
+// This program is licensed under the GNU General Public License, version 3.
+// See LICENSE.txt.
+//
+
+#include <algorithm>
+#include <vector>
+
+#include "histogram.h"
+
+static int bucket_index(int32_t value) {
+    int bucket = 0;
+    while (value > 0 && bucket < HISTOGRAM_BUCKETS - 1) {
+        value >>= 1;
+        bucket++;
+    }
+    return bucket;
+}
+
+void histogram_init(Histogram *histogram) {
+    histogram->count = 0;
+    std::fill(histogram->buckets, histogram->buckets + HISTOGRAM_BUCKETS, 0);
+}
+
+void histogram_add(Histogram *histogram, int32_t value) {
+    int32_t *slot = &histogram->samples[histogram->count % HISTOGRAM_SAMPLES];
+    if (histogram->count >= HISTOGRAM_SAMPLES) {
+        // The oldest sample leaves the window.
+        histogram->buckets[bucket_index(*slot)]--;
+    }
+    *slot = value;
+    histogram->buckets[bucket_index(value)]++;
+    histogram->count++;
+}
+
+size_t histogram_size(const Histogram *histogram) {
+    return std::min<uint64_t>(histogram->count, HISTOGRAM_SAMPLES);
+}
+
+int32_t histogram_percentile(const Histogram *histogram, int percentile) {
+    size_t size = histogram_size(histogram);
+    if (size == 0) {
+        return 0;
+    }
+    std::vector<int32_t> sorted(histogram->samples, histogram->samples + size);
+    auto nth = sorted.begin() + (size - 1) * percentile / 100;
+    std::nth_element(sorted.begin(), nth, sorted.end());
+    return *nth;
+}
+
+int32_t histogram_max(const Histogram *histogram) {
+    size_t size = histogram_size(histogram);
+    if (size == 0) {
+        return 0;
+    }
+    return *std::max_element(histogram->samples, histogram->samples + size);
+}
+
+int32_t histogram_bucket_floor(int bucket) {
+    return bucket == 0 ? 0 : 1 << (bucket - 1);
+}
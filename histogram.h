@@ -0,0 +1,36 @@
+// Copyright © 2020 Mateus Carmo Martins de Freitas Barbosa
+//
+// This program is licensed under the GNU General Public License, version 3.
+// See LICENSE.txt.
+//
+
+#ifndef STACKTILE_HISTOGRAM_H
+#define STACKTILE_HISTOGRAM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+static const int HISTOGRAM_SAMPLES = 1024;
+static const int HISTOGRAM_BUCKETS = 32;
+
+// A rolling histogram over the last HISTOGRAM_SAMPLES values. Besides the
+// raw samples, which percentiles are computed from, it keeps them counted
+// in power-of-two buckets: bucket 0 holds values below 1 and bucket i
+// holds values in [2^(i-1), 2^i). The last bucket takes everything above.
+struct Histogram {
+    int32_t samples[HISTOGRAM_SAMPLES];
+    uint64_t count;
+    uint32_t buckets[HISTOGRAM_BUCKETS];
+};
+
+void histogram_init(Histogram *histogram);
+void histogram_add(Histogram *histogram, int32_t value);
+// How many samples are in the window.
+size_t histogram_size(const Histogram *histogram);
+// Returns 0 when empty.
+int32_t histogram_percentile(const Histogram *histogram, int percentile);
+int32_t histogram_max(const Histogram *histogram);
+// The smallest value counted in the bucket.
+int32_t histogram_bucket_floor(int bucket);
+
+#endif /* STACKTILE_HISTOGRAM_H */
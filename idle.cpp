@@ -0,0 +1,103 @@
+// Copyright © 2020 Mateus Carmo Martins de Freitas Barbosa
+//
+// This program is licensed under the GNU General Public License, version 3.
+// See LICENSE.txt.
+//
+
+#include <time.h>
+#include <wayland-server-core.h>
+
+extern "C" {
+#define static
+
+#include <wlr/types/wlr_box.h>
+#include <wlr/types/wlr_idle_inhibit_v1.h>
+#include <wlr/types/wlr_output.h>
+#include <wlr/types/wlr_surface.h>
+#include <wlr/util/log.h>
+
+#undef static
+}
+
+#include "idle.h"
+#include "output.h"
+#include "server.h"
+#include "surface.h"
+
+static int64_t now_msec() {
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000LL + now.tv_nsec / 1000000;
+}
+
+static bool idle_inhibited(Server *server) {
+    wlr_idle_inhibitor_v1 *inhibitor;
+    wl_list_for_each(inhibitor, &server->idle_inhibit->inhibitors, link) {
+        auto surface = reinterpret_cast<Surface*>(inhibitor->surface->data);
+        if (surface != NULL && surface->visible_outputs != 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void set_outputs_power(Server *server, bool on) {
+    server->outputs_asleep = !on;
+    Output *output;
+    wl_list_for_each(output, &server->outputs, link) {
+        output_set_power(output, on);
+    }
+}
+
+// Input doesn't touch the timer, which would be a syscall per event. It
+// only moves last_activity_msec, and the timer looks at it when it fires.
+static int idle_handle_timer(void *data) {
+    auto server = reinterpret_cast<Server*>(data);
+    int64_t idle = now_msec() - server->last_activity_msec;
+    if (idle < server->idle_timeout_msec) {
+        wl_event_source_timer_update(server->idle_timer, server->idle_timeout_msec - idle);
+        return 0;
+    }
+    if (idle_inhibited(server)) {
+        wl_event_source_timer_update(server->idle_timer, server->idle_timeout_msec);
+        return 0;
+    }
+    wlr_log(WLR_DEBUG, "Idle for %d s, powering outputs off", server->idle_timeout_msec / 1000);
+    set_outputs_power(server, false);
+    return 0;
+}
+
+void idle_init(Server *server, int timeout_sec) {
+    server->idle_inhibit = wlr_idle_inhibit_v1_create(server->display);
+    server->idle_timeout_msec = timeout_sec > 0 ? timeout_sec * 1000 : 0;
+    server->last_activity_msec = now_msec();
+    server->outputs_asleep = false;
+    server->idle_timer = NULL;
+    if (server->idle_timeout_msec > 0) {
+        server->idle_timer = wl_event_loop_add_timer(
+            wl_display_get_event_loop(server->display),
+            idle_handle_timer,
+            server
+        );
+        wl_event_source_timer_update(server->idle_timer, server->idle_timeout_msec);
+    }
+}
+
+void idle_finish(Server *server) {
+    if (server->idle_timer != NULL) {
+        wl_event_source_remove(server->idle_timer);
+        server->idle_timer = NULL;
+    }
+}
+
+void idle_notify_activity(Server *server) {
+    if (server->idle_timer == NULL) {
+        return;
+    }
+    server->last_activity_msec = now_msec();
+    if (server->outputs_asleep) {
+        wlr_log(WLR_DEBUG, "Input, powering outputs on");
+        set_outputs_power(server, true);
+        wl_event_source_timer_update(server->idle_timer, server->idle_timeout_msec);
+    }
+}
@@ -0,0 +1,20 @@
+// Copyright © 2020 Mateus Carmo Martins de Freitas Barbosa
+//
+// This program is licensed under the GNU General Public License, version 3.
+// See LICENSE.txt.
+//
+
+#ifndef STACKTILE_IDLE_H
+#define STACKTILE_IDLE_H
+
+struct Server;
+
+// Powers outputs off after timeout_sec without input, unless a visible
+// surface inhibits idling through idle-inhibit-unstable-v1. 0 never does.
+void idle_init(Server *server, int timeout_sec);
+void idle_finish(Server *server);
+
+// Called on every input event, powers outputs back on if they were off.
+void idle_notify_activity(Server *server);
+
+#endif /* STACKTILE_IDLE_H */
@@ -13,24 +13,50 @@ extern "C" {
 #include <wlr/types/wlr_box.h>
 #include <wlr/types/wlr_input_device.h>
 #include <wlr/types/wlr_keyboard.h>
+#include <wlr/types/wlr_keyboard_group.h>
 #include <wlr/types/wlr_seat.h>
 #include <wlr/types/wlr_xdg_shell.h>
+#include <wlr/util/log.h>
 #include <xkbcommon/xkbcommon.h>
 
 #undef static
 }
 
+#include "arrange.h"
+#include "idle.h"
 #include "keyboard.h"
+#include "keymap.h"
 #include "server.h"
+#include "stats.h"
+#include "trace.h"
 #include "view.h"
 
+// Only switches the seat's keyboard when input moves to a group with
+// another keymap, or to a keyboard outside the groups.
+static void keyboard_activate(Server *server, wlr_input_device *device) {
+    wlr_seat *seat = server->seat;
+    if (wlr_seat_get_keyboard(seat) != device->keyboard) {
+        wlr_seat_set_keyboard(seat, device);
+    }
+}
+
+static void keyboard_group_activate(KeyboardGroup *group) {
+    keyboard_activate(group->server, group->group->input_device);
+}
+
+static void handle_modifiers(Server *server, wlr_input_device *device) {
+    keyboard_activate(server, device);
+    wlr_seat_keyboard_notify_modifiers(server->seat, &device->keyboard->modifiers);
+}
+
+static void keyboard_group_handle_modifiers(wl_listener *listener, void *data) {
+    KeyboardGroup *group = wl_container_of(listener, group, modifiers);
+    handle_modifiers(group->server, group->group->input_device);
+}
+
 static void keyboard_handle_modifiers(wl_listener *listener, void *data) {
     Keyboard *keyboard = wl_container_of(listener, keyboard, modifiers);
-    wlr_seat_set_keyboard(keyboard->server->seat, keyboard->device);
-    wlr_seat_keyboard_notify_modifiers(
-        keyboard->server->seat,
-        &keyboard->device->keyboard->modifiers
-    );
+    handle_modifiers(keyboard->server, keyboard->device);
 }
 
 static bool handle_keybinding(Server *server, xkb_keysym_t sym) {
@@ -56,27 +82,72 @@ static bool handle_keybinding(Server *server, xkb_keysym_t sym) {
             link
         );
         focus_view(next_view, next_view->xdg_surface->surface);
-        // Move the previous view to the end of the list
-        wl_list_remove(&current_view->link);
-        wl_list_insert(server->views.prev, &current_view->link);
+        // Move the previous view to the bottom of the stack
+        view_lower(current_view);
         break;
     }
+    // Focus and move between stacks, moving a view out of its stack when
+    // it isn't alone, and into the neighbouring one when it is.
+    case XKB_KEY_h:
+        arrange_focus(server, EDGE_LEFT);
+        break;
+    case XKB_KEY_j:
+        arrange_focus(server, EDGE_BOTTOM);
+        break;
+    case XKB_KEY_k:
+        arrange_focus(server, EDGE_TOP);
+        break;
+    case XKB_KEY_l:
+        arrange_focus(server, EDGE_RIGHT);
+        break;
+    case XKB_KEY_H:
+        arrange_move(server, EDGE_LEFT);
+        break;
+    case XKB_KEY_J:
+        arrange_move(server, EDGE_BOTTOM);
+        break;
+    case XKB_KEY_K:
+        arrange_move(server, EDGE_TOP);
+        break;
+    case XKB_KEY_L:
+        arrange_move(server, EDGE_RIGHT);
+        break;
+    case XKB_KEY_n:
+        arrange_cycle_stack(server);
+        break;
+    case XKB_KEY_equal:
+        arrange_grow(server, EDGE_RIGHT, 0.05);
+        break;
+    case XKB_KEY_minus:
+        arrange_grow(server, EDGE_RIGHT, -0.05);
+        break;
+    case XKB_KEY_plus:
+        arrange_grow(server, EDGE_BOTTOM, 0.05);
+        break;
+    case XKB_KEY_underscore:
+        arrange_grow(server, EDGE_BOTTOM, -0.05);
+        break;
+    case XKB_KEY_space:
+        arrange_toggle_floating(server);
+        break;
     default:
         return false;
     }
     return true;
 }
 
-static void keyboard_handle_key(wl_listener *listener, void *data) {
-    Keyboard *keyboard = wl_container_of(listener, keyboard, key);
-    Server *server = keyboard->server;
-    auto event = reinterpret_cast<wlr_event_keyboard_key*>(data);
+static void handle_key(Server *server,
+                       wlr_input_device *device,
+                       wlr_event_keyboard_key *event) {
+    TRACE_SCOPE("keyboard_handle_key");
+    wlr_keyboard *_wlr_keyboard = device->keyboard;
     wlr_seat *seat = server->seat;
+    idle_notify_activity(server);
 
     uint32_t keycode = event->keycode + 8;
     const xkb_keysym_t *syms;
     int nsyms = xkb_state_key_get_syms(
-        keyboard->device->keyboard->xkb_state,
+        _wlr_keyboard->xkb_state,
         keycode,
         &syms
     );
@@ -85,22 +156,107 @@ static void keyboard_handle_key(wl_listener *listener, void *data) {
     enum wlr_keyboard_modifier prefix_key_mask = WLR_MODIFIER_LOGO;
 
     bool handled = false;
-    uint32_t modifiers = wlr_keyboard_get_modifiers(keyboard->device->keyboard);
+    uint32_t modifiers = wlr_keyboard_get_modifiers(_wlr_keyboard);
     if ((modifiers & prefix_key_mask) && event->state == WLR_KEY_PRESSED) {
         for (int i = 0; i < nsyms; i++) {
-            handled = handle_keybinding(server, syms[i]);
+            // A key with more than one keysym is bound if any of them is.
+            handled = handle_keybinding(server, syms[i]) || handled;
         }
     }
 
+    wlr_surface *target = NULL;
     if (!handled) {
-        wlr_seat_set_keyboard(seat, keyboard->device);
+        keyboard_activate(server, device);
         wlr_seat_keyboard_notify_key(
             seat,
             event->time_msec,
             event->keycode,
             event->state
         );
+        target = seat->keyboard_state.focused_surface;
+    }
+    stats_input_handled(server, event->time_msec, target);
+}
+
+static void keyboard_group_handle_key(wl_listener *listener, void *data) {
+    KeyboardGroup *group = wl_container_of(listener, group, key);
+    handle_key(
+        group->server,
+        group->group->input_device,
+        reinterpret_cast<wlr_event_keyboard_key*>(data)
+    );
+}
+
+static void keyboard_handle_key(wl_listener *listener, void *data) {
+    Keyboard *keyboard = wl_container_of(listener, keyboard, key);
+    handle_key(
+        keyboard->server,
+        keyboard->device,
+        reinterpret_cast<wlr_event_keyboard_key*>(data)
+    );
+}
+
+static KeyboardGroup *keyboard_group_for_keymap(Server *server, xkb_keymap *keymap) {
+    KeyboardGroup *group;
+    wl_list_for_each(group, &server->keyboard_groups, link) {
+        if (group->keymap == keymap) {
+            return group;
+        }
+    }
+
+    group = new KeyboardGroup;
+    group->server = server;
+    group->group = wlr_keyboard_group_create();
+    group->keymap = keymap;
+    group->members = 0;
+    wlr_keyboard *_wlr_keyboard = &group->group->keyboard;
+    wlr_keyboard_set_keymap(_wlr_keyboard, keymap);
+    wlr_keyboard_set_repeat_info(_wlr_keyboard, 25, 600);
+
+    group->modifiers.notify = keyboard_group_handle_modifiers;
+    wl_signal_add(&_wlr_keyboard->events.modifiers, &group->modifiers);
+    group->key.notify = keyboard_group_handle_key;
+    wl_signal_add(&_wlr_keyboard->events.key, &group->key);
+
+    wl_list_insert(&server->keyboard_groups, &group->link);
+    return group;
+}
+
+static void keyboard_group_destroy(KeyboardGroup *group) {
+    Server *server = group->server;
+    bool active = wlr_seat_get_keyboard(server->seat) == &group->group->keyboard;
+    wl_list_remove(&group->link);
+    wl_list_remove(&group->modifiers.link);
+    wl_list_remove(&group->key.link);
+    if (active) {
+        // Hand the seat over to any remaining group.
+        wlr_input_device *device = NULL;
+        if (!wl_list_empty(&server->keyboard_groups)) {
+            KeyboardGroup *next = wl_container_of(server->keyboard_groups.next, next, link);
+            device = next->group->input_device;
+        }
+        wlr_seat_set_keyboard(server->seat, device);
+    }
+    wlr_keyboard_group_destroy(group->group);
+    delete group;
+}
+
+static void keyboard_handle_destroy(wl_listener *listener, void *data) {
+    Keyboard *keyboard = wl_container_of(listener, keyboard, destroy);
+    KeyboardGroup *group = keyboard->group;
+    if (group != NULL) {
+        wlr_keyboard_group_remove_keyboard(group->group, keyboard->device->keyboard);
+        group->members--;
+        if (group->members == 0) {
+            keyboard_group_destroy(group);
+        }
+    } else {
+        wl_list_remove(&keyboard->modifiers.link);
+        wl_list_remove(&keyboard->key.link);
     }
+    wl_list_remove(&keyboard->destroy.link);
+    wl_list_remove(&keyboard->link);
+    delete keyboard;
 }
 
 void handle_new_keyboard(Server *server,
@@ -110,24 +266,37 @@ void handle_new_keyboard(Server *server,
     keyboard->device = device;
 
     xkb_rule_names rules = { 0 };
-    xkb_context *context = xkb_context_new(XKB_CONTEXT_NO_FLAGS);
-    xkb_keymap *keymap = xkb_map_new_from_names(
-        context,
-        &rules,
-        XKB_KEYMAP_COMPILE_NO_FLAGS
-    );
-
+    xkb_keymap *keymap = keymap_cache_get(&server->keymaps, &rules);
+    if (keymap == NULL) {
+        wlr_log(WLR_ERROR, "Failed to compile a keymap for %s", device->name);
+        delete keyboard;
+        return;
+    }
     wlr_keyboard_set_keymap(device->keyboard, keymap);
-    xkb_keymap_unref(keymap);
-    xkb_context_unref(context);
     wlr_keyboard_set_repeat_info(device->keyboard, 25, 600);
 
-    keyboard->modifiers.notify = keyboard_handle_modifiers;
-    wl_signal_add(&device->keyboard->events.modifiers, &keyboard->modifiers);
-    keyboard->key.notify = keyboard_handle_key;
-    wl_signal_add(&device->keyboard->events.key, &keyboard->key);
-
-    wlr_seat_set_keyboard(server->seat, device);
+    // Key and modifier events now come from the group's keyboard.
+    KeyboardGroup *group = keyboard_group_for_keymap(server, keymap);
+    if (wlr_keyboard_group_add_keyboard(group->group, device->keyboard)) {
+        keyboard->group = group;
+        group->members++;
+        keyboard_group_activate(group);
+    } else {
+        // The keyboard still works on its own, with the seat switching to
+        // it whenever it's used.
+        wlr_log(WLR_ERROR, "Failed to add %s to its keyboard group", device->name);
+        if (group->members == 0) {
+            keyboard_group_destroy(group);
+        }
+        keyboard->group = NULL;
+        keyboard->modifiers.notify = keyboard_handle_modifiers;
+        wl_signal_add(&device->keyboard->events.modifiers, &keyboard->modifiers);
+        keyboard->key.notify = keyboard_handle_key;
+        wl_signal_add(&device->keyboard->events.key, &keyboard->key);
+        keyboard_activate(server, device);
+    }
+    keyboard->destroy.notify = keyboard_handle_destroy;
+    wl_signal_add(&device->events.destroy, &keyboard->destroy);
 
     wl_list_insert(&server->keyboards, &keyboard->link);
 }
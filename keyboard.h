@@ -9,15 +9,36 @@
 
 #include <wayland-server-core.h>
 struct wlr_input_device;
+struct wlr_keyboard_group;
+struct xkb_keymap;
 struct Server;
 
+// Keyboards sharing a keymap are merged into a group, and the seat only
+// ever sees the groups. Typing on another device of the same group
+// doesn't switch the seat's keyboard, so clients aren't sent the keymap
+// and modifiers all over again.
+struct KeyboardGroup {
+    wl_list link;
+    Server *server;
+    wlr_keyboard_group *group;
+    xkb_keymap *keymap;
+    int members;
+
+    wl_listener modifiers;
+    wl_listener key;
+};
+
 struct Keyboard {
     wl_list link;
     Server *server;
     wlr_input_device *device;
+    // NULL when the keyboard couldn't join a group, and its own key and
+    // modifier events are listened to instead.
+    KeyboardGroup *group;
 
     wl_listener modifiers;
     wl_listener key;
+    wl_listener destroy;
 };
 
 void handle_new_keyboard(Server *server,
@@ -0,0 +1,227 @@
+// Copyright © 2020 Mateus Carmo Martins de Freitas Barbosa
+//
+// This program is licensed under the GNU General Public License, version 3.
+// See LICENSE.txt.
+//
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <wayland-server-core.h>
+#include <xkbcommon/xkbcommon.h>
+
+extern "C" {
+#define static
+
+#include <wlr/util/log.h>
+
+#undef static
+}
+
+#include "keymap.h"
+
+// Both come from pkg-config at build time, see the Makefile.
+#ifndef XKEYBOARD_CONFIG_VERSION
+#define XKEYBOARD_CONFIG_VERSION "unknown"
+#endif
+#ifndef XKEYBOARD_CONFIG_ROOT
+#define XKEYBOARD_CONFIG_ROOT "/usr/share/X11/xkb"
+#endif
+
+// The first line of every cache file, followed by the cache key and the
+// keymap.
+static const char KEYMAP_CACHE_MAGIC[] = "stacktile keymap cache 1\n";
+
+static const char *rule_or_default(const char *name, const char *env, const char *fallback) {
+    if (name != NULL && name[0] != '\0') {
+        return name;
+    }
+    const char *value = getenv(env);
+    if (value != NULL && value[0] != '\0') {
+        return value;
+    }
+    return fallback;
+}
+
+// The rules as libxkbcommon resolves them. The key tells apart keymaps
+// compiled in this session.
+static std::string rules_key(const xkb_rule_names *rules) {
+    std::string key;
+    key += rule_or_default(rules->rules, "XKB_DEFAULT_RULES", "evdev");
+    key += '\n';
+    key += rule_or_default(rules->model, "XKB_DEFAULT_MODEL", "pc105");
+    key += '\n';
+    key += rule_or_default(rules->layout, "XKB_DEFAULT_LAYOUT", "us");
+    key += '\n';
+    key += rule_or_default(rules->variant, "XKB_DEFAULT_VARIANT", "");
+    key += '\n';
+    key += rule_or_default(rules->options, "XKB_DEFAULT_OPTIONS", "");
+    key += '\n';
+    return key;
+}
+
+// Besides the rules, what's on disk depends on the xkeyboard-config data
+// it was compiled from. The version alone misses distribution patches, so
+// the rules file's modification time goes in too.
+static std::string disk_key(const xkb_rule_names *rules) {
+    std::string key = rules_key(rules);
+    key += XKEYBOARD_CONFIG_VERSION;
+    key += '\n';
+
+    const char *root = getenv("XKB_CONFIG_ROOT");
+    if (root == NULL || root[0] == '\0') {
+        root = XKEYBOARD_CONFIG_ROOT;
+    }
+    std::string rules_path = root;
+    rules_path += "/rules/";
+    rules_path += rule_or_default(rules->rules, "XKB_DEFAULT_RULES", "evdev");
+    struct stat st;
+    if (stat(rules_path.c_str(), &st) == 0) {
+        key += std::to_string(st.st_mtime);
+    }
+    key += '\n';
+    return key;
+}
+
+static std::string cache_path(const std::string &key) {
+    std::string dir;
+    const char *cache_home = getenv("XDG_CACHE_HOME");
+    const char *home = getenv("HOME");
+    if (cache_home != NULL && cache_home[0] == '/') {
+        dir = cache_home;
+    } else if (home != NULL && home[0] == '/') {
+        dir = std::string(home) + "/.cache";
+    } else {
+        return "";
+    }
+    dir += "/stacktile";
+
+    // FNV-1a, collisions are caught by the key stored in the file.
+    uint64_t hash = 14695981039346656037ULL;
+    for (char c : key) {
+        hash ^= static_cast<unsigned char>(c);
+        hash *= 1099511628211ULL;
+    }
+    char name[64];
+    snprintf(name, sizeof(name), "/keymap-%016llx.xkb", (unsigned long long)hash);
+    return dir + name;
+}
+
+static bool read_file(const std::string &path, std::string *contents) {
+    FILE *file = fopen(path.c_str(), "re");
+    if (file == NULL) {
+        return false;
+    }
+    char buffer[16384];
+    size_t n;
+    while ((n = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        contents->append(buffer, n);
+    }
+    bool ok = !ferror(file);
+    fclose(file);
+    return ok;
+}
+
+static xkb_keymap *load_cached_keymap(KeymapCache *cache,
+                                      const std::string &path,
+                                      const std::string &key) {
+    std::string contents;
+    if (path.empty() || !read_file(path, &contents)) {
+        return NULL;
+    }
+    std::string header = KEYMAP_CACHE_MAGIC + key;
+    if (contents.compare(0, header.size(), header) != 0) {
+        return NULL;
+    }
+    return xkb_keymap_new_from_buffer(
+        cache->context,
+        contents.data() + header.size(),
+        contents.size() - header.size(),
+        XKB_KEYMAP_FORMAT_TEXT_V1,
+        XKB_KEYMAP_COMPILE_NO_FLAGS
+    );
+}
+
+static void mkdir_parents(const std::string &path) {
+    for (size_t i = 1; i < path.size(); i++) {
+        if (path[i] == '/') {
+            mkdir(path.substr(0, i).c_str(), 0700);
+        }
+    }
+}
+
+static void save_cached_keymap(const std::string &path,
+                               const std::string &key,
+                               xkb_keymap *keymap) {
+    if (path.empty()) {
+        return;
+    }
+    char *string = xkb_keymap_get_as_string(keymap, XKB_KEYMAP_FORMAT_TEXT_V1);
+    if (string == NULL) {
+        return;
+    }
+    mkdir_parents(path);
+
+    // Written aside and renamed over, so that concurrent sessions never
+    // read a partial file.
+    std::string tmp_path = path + ".XXXXXX";
+    int fd = mkostemp(&tmp_path[0], O_CLOEXEC);
+    if (fd < 0) {
+        wlr_log(WLR_DEBUG, "Can't write keymap cache %s: %s", path.c_str(), strerror(errno));
+        free(string);
+        return;
+    }
+    FILE *file = fdopen(fd, "w");
+    bool ok = file != NULL &&
+        fputs(KEYMAP_CACHE_MAGIC, file) >= 0 &&
+        fputs(key.c_str(), file) >= 0 &&
+        fputs(string, file) >= 0;
+    ok = (file != NULL ? fclose(file) == 0 : close(fd) == 0) && ok;
+    if (!ok || rename(tmp_path.c_str(), path.c_str()) < 0) {
+        unlink(tmp_path.c_str());
+    }
+    free(string);
+}
+
+void keymap_cache_init(KeymapCache *cache) {
+    cache->context = xkb_context_new(XKB_CONTEXT_NO_FLAGS);
+}
+
+void keymap_cache_finish(KeymapCache *cache) {
+    for (auto &entry : cache->keymaps) {
+        xkb_keymap_unref(entry.second);
+    }
+    cache->keymaps.clear();
+    xkb_context_unref(cache->context);
+    cache->context = NULL;
+}
+
+xkb_keymap *keymap_cache_get(KeymapCache *cache, const xkb_rule_names *rules) {
+    std::string key = rules_key(rules);
+    auto found = cache->keymaps.find(key);
+    if (found != cache->keymaps.end()) {
+        return found->second;
+    }
+    if (cache->context == NULL) {
+        return NULL;
+    }
+
+    std::string full_key = disk_key(rules);
+    std::string path = cache_path(full_key);
+    xkb_keymap *keymap = load_cached_keymap(cache, path, full_key);
+    if (keymap != NULL) {
+        wlr_log(WLR_DEBUG, "Loaded keymap from %s", path.c_str());
+    } else {
+        keymap = xkb_keymap_new_from_names(cache->context, rules, XKB_KEYMAP_COMPILE_NO_FLAGS);
+        if (keymap == NULL) {
+            return NULL;
+        }
+        save_cached_keymap(path, full_key, keymap);
+    }
+    cache->keymaps[key] = keymap;
+    return keymap;
+}
@@ -0,0 +1,33 @@
+// Copyright © 2020 Mateus Carmo Martins de Freitas Barbosa
+//
+// This program is licensed under the GNU General Public License, version 3.
+// See LICENSE.txt.
+//
+
+#ifndef STACKTILE_KEYMAP_H
+#define STACKTILE_KEYMAP_H
+
+#include <string>
+#include <unordered_map>
+struct xkb_context;
+struct xkb_keymap;
+struct xkb_rule_names;
+
+// Compiling a keymap from rules takes a while, so every distinct set of
+// rules is compiled once per session and shared by all keyboards. Compiled
+// keymaps are also cached on disk, under $XDG_CACHE_HOME/stacktile, keyed
+// by the rules and the xkeyboard-config version they were compiled with.
+struct KeymapCache {
+    xkb_context *context;
+    std::unordered_map<std::string, xkb_keymap*> keymaps;
+};
+
+void keymap_cache_init(KeymapCache *cache);
+void keymap_cache_finish(KeymapCache *cache);
+
+// Returns a keymap owned by the cache, or NULL if it can't be compiled.
+// Unset rule names take the XKB_DEFAULT_* environment variables, as in
+// libxkbcommon.
+xkb_keymap *keymap_cache_get(KeymapCache *cache, const xkb_rule_names *rules);
+
+#endif /* STACKTILE_KEYMAP_H */
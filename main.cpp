@@ -0,0 +1,126 @@
+// Copyright © 2020 Mateus Carmo Martins de Freitas Barbosa
+//
+// This program is licensed under the GNU General Public License, version 3.
+// See LICENSE.txt.
+//
+
+#include <getopt.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <wayland-server-core.h>
+
+extern "C" {
+#define static
+
+#include <wlr/types/wlr_box.h>
+#include <wlr/util/log.h>
+
+#undef static
+}
+
+#include "rfb.h"
+#include "server.h"
+#include "trace.h"
+
+static void usage(const char *name) {
+    printf("Usage: %s [-s startup command] [-f hidden frame rate] [-t trace file]\n"
+           "       [-c software render threads] [-v output=[address:]port]...\n"
+           "       [-a adaptive sync output]... [-i idle timeout seconds] [-F]\n"
+           "  -i 0 never powers outputs off, which is the default\n"
+           "  -F lets new views float instead of tiling them\n", name);
+}
+
+int main(int argc, char *argv[]) {
+    wlr_log_init(WLR_DEBUG, NULL);
+    char *startup_cmd = NULL;
+    char *trace_path = NULL;
+    ServerConfig config;
+    server_config_init(&config);
+
+    int c;
+    while ((c = getopt(argc, argv, "s:f:t:c:v:a:i:Fh")) != -1) {
+        switch (c) {
+        case 's':
+            startup_cmd = optarg;
+            break;
+        case 'f':
+            config.hidden_frame_rate = atoi(optarg);
+            break;
+        case 't':
+            trace_path = optarg;
+            break;
+        case 'c':
+            config.software_threads = atoi(optarg);
+            if (config.software_threads < 0) {
+                config.software_threads = 0;
+            }
+            break;
+        case 'v': {
+            RfbConfig rfb;
+            if (!rfb_parse_config(optarg, &rfb)) {
+                usage(argv[0]);
+                return 1;
+            }
+            config.rfb.push_back(rfb);
+            break;
+        }
+        case 'a':
+            config.adaptive_sync_outputs.push_back(optarg);
+            break;
+        case 'i': {
+            // 0 never idles. Longer than this doesn't fit in milliseconds.
+            char *end;
+            long timeout = strtol(optarg, &end, 10);
+            if (*optarg == '\0' || *end != '\0' || timeout < 0 || timeout > INT_MAX / 1000) {
+                usage(argv[0]);
+                return 1;
+            }
+            config.idle_timeout = timeout;
+            break;
+        }
+        case 'F':
+            config.tiling = false;
+            break;
+        default:
+            usage(argv[0]);
+            return 0;
+        }
+    }
+    if (optind < argc) {
+        usage(argv[0]);
+        return 0;
+    }
+
+    if (trace_path != NULL && !trace_init(trace_path)) {
+        wlr_log(WLR_ERROR, "failed to open trace file %s", trace_path);
+        return 1;
+    }
+
+    Server server;
+    if (!server_init(&server, &config)) {
+        return 1;
+    }
+    if (startup_cmd) {
+        pid_t child = fork();
+        if (child == 0) {
+            // The event loop blocks the signals it handles, and the mask
+            // would outlive exec.
+            sigset_t mask;
+            sigemptyset(&mask);
+            sigprocmask(SIG_SETMASK, &mask, NULL);
+            execl("/bin/sh", "/bin/sh", "-c", startup_cmd, (void *)NULL);
+        } else if (child < 0) {
+            wlr_log(WLR_ERROR, "failed to fork child process!");
+            wl_display_destroy(server.display);
+            return 1;
+        }
+    }
+    wl_display_run(server.display);
+
+    trace_finish();
+    server_finish(&server);
+    return 0;
+}
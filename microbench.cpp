@@ -0,0 +1,197 @@
+// Copyright © 2020 Mateus Carmo Martins de Freitas Barbosa
+//
+// This program is licensed under the GNU General Public License, version 3.
+// See LICENSE.txt.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <random>
+#include <vector>
+
+#include "geometry.h"
+#include "grid.h"
+#include "stacking.h"
+#include "tiling.h"
+
+// Runs each case for at least this long.
+static const double CASE_MIN_SEC = 0.2;
+static const int LAYOUT_WIDTH = 3840 * 2;
+static const int LAYOUT_HEIGHT = 2160;
+
+struct Scene {
+    Grid grid;
+    Stacking stacking;
+    std::vector<GridItem> items;
+    TileTree tiles;
+    std::vector<TileWindow> windows;
+    std::mt19937 rng;
+};
+
+static double now_sec() {
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+static int random_int(Scene *scene, int min, int max) {
+    return std::uniform_int_distribution<int>(min, max)(scene->rng);
+}
+
+static Box random_box(Scene *scene) {
+    Box box;
+    box.width = random_int(scene, 200, 1600);
+    box.height = random_int(scene, 150, 1000);
+    box.x = random_int(scene, -box.width / 2, LAYOUT_WIDTH - box.width / 2);
+    box.y = random_int(scene, -box.height / 2, LAYOUT_HEIGHT - box.height / 2);
+    return box;
+}
+
+static void scene_init(Scene *scene, int count) {
+    scene->rng.seed(count);
+    stacking_init(&scene->stacking);
+    // The grid keeps pointers to the items, so they can't move anymore.
+    scene->items.resize(count);
+    for (GridItem &item : scene->items) {
+        grid_item_init(&item, NULL);
+        Box box = random_box(scene);
+        grid_update(&scene->grid, &item, &box, stacking_raise(&scene->stacking));
+    }
+
+    tile_tree_init(&scene->tiles);
+    Box area { 0, 0, LAYOUT_WIDTH, LAYOUT_HEIGHT };
+    tile_tree_set_area(&scene->tiles, &area);
+    scene->windows.resize(count);
+    for (int i = 0; i < count; i++) {
+        TileWindow *window = &scene->windows[i];
+        tile_window_init(window, NULL);
+        TileWindow *near = i > 0 ? &scene->windows[random_int(scene, 0, i - 1)] : NULL;
+        tile_insert_split(&scene->tiles, window, near);
+    }
+    tile_tree_clear_changed(&scene->tiles);
+}
+
+static void scene_finish(Scene *scene) {
+    for (TileWindow &window : scene->windows) {
+        tile_remove(&window);
+    }
+    tile_tree_finish(&scene->tiles);
+}
+
+// Calls f in batches until CASE_MIN_SEC have passed, returns operations
+// per second.
+template<typename F>
+static double measure(F f) {
+    const int batch = 1024;
+    long ops = 0;
+    double start = now_sec(), elapsed;
+    do {
+        for (int i = 0; i < batch; i++) {
+            f(i);
+        }
+        ops += batch;
+        elapsed = now_sec() - start;
+    } while (elapsed < CASE_MIN_SEC);
+    return ops / elapsed;
+}
+
+static double bench_hit_test(Scene *scene) {
+    std::vector<double> points(2048);
+    for (double &v : points) {
+        v = random_int(scene, 0, LAYOUT_WIDTH);
+    }
+    size_t hits = 0;
+    double rate = measure([&](int i) {
+        double x = points[i % points.size()];
+        double y = points[(i * 7 + 1) % points.size()] * LAYOUT_HEIGHT / LAYOUT_WIDTH;
+        hits += grid_item_at(&scene->grid, x, y) != NULL;
+    });
+    // Keeps the hit-tests from being optimized away.
+    if (hits == 0 && !scene->items.empty()) {
+        fprintf(stderr, "no hits\n");
+    }
+    return rate;
+}
+
+// Raising is what focusing a view does, lowering is what cycling does.
+static double bench_restack(Scene *scene) {
+    size_t count = scene->items.size();
+    return measure([&](int i) {
+        GridItem *item = &scene->items[random_int(scene, 0, count - 1)];
+        int64_t z = i % 2 ? stacking_raise(&scene->stacking) : stacking_lower(&scene->stacking);
+        Box box = item->box;
+        grid_update(&scene->grid, item, &box, z);
+    });
+}
+
+// An interactive resize of the top item, dragging its bottom-right
+// corner around.
+static double bench_resize(Scene *scene) {
+    GridItem *item = &scene->items.back();
+    Box grab = item->box;
+    return measure([&](int i) {
+        double x = grab.x + grab.width + (i % 200) - 100;
+        double y = grab.y + grab.height + (i % 150) - 75;
+        Box box = box_resize(&grab, EDGE_BOTTOM | EDGE_RIGHT, x, y);
+        grid_update(&scene->grid, item, &box, item->z);
+    });
+}
+
+// A window closing and another one opening next to some other window, or
+// with nothing focused, with the layout changes it causes.
+static double bench_retile(Scene *scene) {
+    size_t count = scene->windows.size();
+    return measure([&](int i) {
+        TileWindow *window = &scene->windows[random_int(scene, 0, count - 1)];
+        tile_remove(window);
+        TileWindow *near = i % 2 ? &scene->windows[random_int(scene, 0, count - 1)] : NULL;
+        tile_insert_split(&scene->tiles, window, near);
+        tile_tree_clear_changed(&scene->tiles);
+    });
+}
+
+// Opening and closing a window must leave every other one where it was,
+// however many times it's done, next to a window or not.
+static bool check_retile_round_trip(Scene *scene) {
+    std::vector<Box> boxes;
+    for (const TileWindow &window : scene->windows) {
+        boxes.push_back(window.box);
+    }
+    size_t count = scene->windows.size();
+    TileWindow extra;
+    tile_window_init(&extra, NULL);
+    for (int i = 0; i < 2000; i++) {
+        TileWindow *near = i % 2 ? &scene->windows[random_int(scene, 0, count - 1)] : NULL;
+        tile_insert_split(&scene->tiles, &extra, near);
+        tile_remove(&extra);
+    }
+    tile_tree_clear_changed(&scene->tiles);
+    for (size_t i = 0; i < count; i++) {
+        if (!box_equal(&scene->windows[i].box, &boxes[i])) {
+            fprintf(stderr, "retiling moved window %zu of %zu\n", i, count);
+            return false;
+        }
+    }
+    return true;
+}
+
+int main() {
+    static const int counts[] = { 10, 100, 1000, 10000 };
+
+    printf("%8s %16s %16s %16s %16s\n", "views", "hit-test/s", "restack/s", "resize/s", "retile/s");
+    for (int count : counts) {
+        Scene scene;
+        scene_init(&scene, count);
+        if (!check_retile_round_trip(&scene)) {
+            return 1;
+        }
+        double hit_test = bench_hit_test(&scene);
+        double restack = bench_restack(&scene);
+        double resize = bench_resize(&scene);
+        double retile = bench_retile(&scene);
+        printf("%8d %16.0f %16.0f %16.0f %16.0f\n", count, hit_test, restack, resize, retile);
+        scene_finish(&scene);
+    }
+    return 0;
+}
@@ -4,6 +4,9 @@
 // See LICENSE.txt.
 //
 
+#include <math.h>
+#include <algorithm>
+#include <vector>
 #include <wayland-server-core.h>
 
 extern "C" {
@@ -12,109 +15,829 @@ extern "C" {
 #include <wlr/render/wlr_renderer.h>
 #include <wlr/types/wlr_matrix.h>
 #include <wlr/types/wlr_output.h>
+#include <wlr/types/wlr_output_damage.h>
 #include <wlr/types/wlr_output_layout.h>
+#include <wlr/types/wlr_presentation_time.h>
 #include <wlr/types/wlr_xdg_shell.h>
+#include <wlr/util/log.h>
+#include <wlr/util/region.h>
 
 #undef static
 }
 
+#include "arrange.h"
 #include "output.h"
+#include "renderlist.h"
+#include "rfb.h"
 #include "server.h"
+#include "surface.h"
+#include "swrender.h"
+#include "trace.h"
+#include "transaction.h"
 #include "view.h"
 
-struct RenderData {
-    wlr_output *output;
-    wlr_renderer *renderer;
-    View *view;
-    timespec *when;
-};
+// How much slack is left between the slowest recent frame and the vblank.
+static const int SAFETY_MARGIN_MIN_USEC = 1000;
+// After this many refresh periods without a present, the last one no
+// longer tells when the next vblank is: the clock drifts, and idle outputs
+// may not have kept scanning out at all.
+static const int PRESENT_PHASE_MAX_PERIODS = 4;
 
-static void render_surface(wlr_surface *surface,
-                           int sx, int sy,
-                           void *data) {
-    auto rdata = reinterpret_cast<RenderData*>(data);
-    View *view = rdata->view;
-    wlr_output *output = rdata->output;
+static int64_t timespec_to_nsec(const timespec *t) {
+    return t->tv_sec * 1000000000LL + t->tv_nsec;
+}
 
-    wlr_texture *texture = wlr_surface_get_texture(surface);
-    if (texture == NULL) {
+static void output_update_max_render_time(Output *output) {
+    if (output->render_time_count < static_cast<unsigned int>(RENDER_TIME_SAMPLES)) {
+        // Not enough samples yet, keep rendering right away.
         return;
     }
+    int worst = 0;
+    for (int i = 0; i < RENDER_TIME_SAMPLES; i++) {
+        if (output->render_time_usec[i] > worst) {
+            worst = output->render_time_usec[i];
+        }
+    }
+    int max_render_time = (worst + output->safety_margin_usec + 999) / 1000;
+    if (output->refresh_nsec > 0 && max_render_time * 1000000LL >= output->refresh_nsec) {
+        // Too slow to delay anything at all.
+        max_render_time = 0;
+    }
+    if (max_render_time != output->max_render_time) {
+        output->max_render_time = max_render_time;
+        wlr_log(WLR_INFO, "Output %s: max render time is now %d ms",
+                output->output->name, max_render_time);
+    }
+}
 
-    // The view has a position in layout coordinates.
-    // We need to translate that to output-local coordinates.
-    //
-    double ox = 0, oy = 0;
-    wlr_output_layout_output_coords(view->server->output_layout, output, &ox, &oy);
-    ox += view->x + sx, oy += view->y + sy;
+static void output_record_render_time(Output *output, int usec) {
+    output->render_time_usec[output->render_time_count % RENDER_TIME_SAMPLES] = usec;
+    output->render_time_count++;
+    output_update_max_render_time(output);
+}
+
+static void scale_box(wlr_box *box, float scale) {
+    int x = floor(box->x * scale);
+    int y = floor(box->y * scale);
+    box->width = ceil((box->x + box->width) * scale) - x;
+    box->height = ceil((box->y + box->height) * scale) - y;
+    box->x = x;
+    box->y = y;
+}
 
+// Damage regions are kept in output-buffer coordinates, before the output
+// transform is applied, while the scissor box must be in framebuffer
+// coordinates.
+static void scissor_output(wlr_output *output, pixman_box32_t *rect) {
+    wlr_renderer *renderer = wlr_backend_get_renderer(output->backend);
     wlr_box box {
-        static_cast<int>(ox * output->scale),
-        static_cast<int>(oy * output->scale),
-        static_cast<int>(surface->current.width * output->scale),
-        static_cast<int>(surface->current.height * output->scale),
+        rect->x1,
+        rect->y1,
+        rect->x2 - rect->x1,
+        rect->y2 - rect->y1,
     };
 
-    float matrix[9];
-    enum wl_output_transform transform = wlr_output_transform_invert(
-        surface->current.transform
+    int ow, oh;
+    wlr_output_transformed_resolution(output, &ow, &oh);
+    enum wl_output_transform transform = wlr_output_transform_invert(output->transform);
+    wlr_box_transform(&box, &box, transform, ow, oh);
+
+    wlr_renderer_scissor(renderer, &box);
+}
+
+// Removes the part of the surface the client promised to be opaque from the
+// uncovered region. With fractional scales the scaled region may round
+// outwards and reveal a gap, so only integer scales are trusted.
+static void cover_opaque_region(wlr_output *output,
+                                RenderEntry *entry,
+                                pixman_region32_t *uncovered) {
+    float scale = output->scale;
+    if (scale != floor(scale) ||
+        !pixman_region32_not_empty(&entry->surface->opaque_region)) {
+        return;
+    }
+    pixman_region32_t opaque;
+    pixman_region32_init(&opaque);
+    wlr_region_scale(&opaque, &entry->surface->opaque_region, scale);
+    pixman_region32_translate(&opaque, entry->box.x, entry->box.y);
+    pixman_region32_intersect_rect(
+        &opaque,
+        &opaque,
+        entry->box.x,
+        entry->box.y,
+        entry->box.width,
+        entry->box.height
     );
+    pixman_region32_subtract(uncovered, uncovered, &opaque);
+    pixman_region32_fini(&opaque);
+}
+
+// Forgets which surfaces were visible on the output.
+static void output_clear_visible(Output *output) {
+    for (Surface *surface : output->visible) {
+        surface->visible_outputs &= ~output->mask;
+    }
+    output->visible.clear();
+}
+
+// Surfaces that just became hidden may still be waiting for a frame
+// callback, which is now up to the hidden surfaces timer.
+static void check_newly_hidden(std::vector<Surface*> *previous) {
+    for (Surface *surface : *previous) {
+        if (surface->visible_outputs == 0) {
+            surface_schedule_hidden_frame(surface);
+        }
+    }
+}
+
+// Walks the views front-to-back over the whole output, working out which
+// surfaces are at least partly visible, and collects the ones that have a
+// visible damaged part. Entries end up in front-to-back order, and uncovered
+// is left with the part of the output no opaque surface hides.
+// Fills entries, which must have room for the whole render list, and
+// returns how many views have something to repaint.
+static int collect_visible(Output *output,
+                           pixman_region32_t *damage,
+                           RenderEntry *entries,
+                           size_t *count,
+                           pixman_region32_t *uncovered) {
+    TRACE_SCOPE("collect_visible");
+    wlr_output *_wlr_output = output->output;
+    float scale = _wlr_output->scale;
+    const wlr_box *layout_box = &output->layout_box;
+
+    int width, height;
+    wlr_output_transformed_resolution(_wlr_output, &width, &height);
+    pixman_region32_union_rect(uncovered, uncovered, 0, 0, width, height);
+
+    std::vector<Surface*> previous = output->visible;
+    output_clear_visible(output);
+
+    pixman_region32_t visible;
+    pixman_region32_init(&visible);
+
+    int views_drawn = 0;
+    View *last_drawn = NULL;
+    *count = 0;
+    for (const RenderListEntry &item : output->server->render_list.entries) {
+        if (!pixman_region32_not_empty(uncovered)) {
+            // Everything below is hidden.
+            break;
+        }
+        if (!output_intersects(output, &item.box)) {
+            continue;
+        }
+        wlr_texture *texture = wlr_surface_get_texture(item.surface);
+        if (texture == NULL) {
+            continue;
+        }
+
+        RenderEntry *entry = &entries[*count];
+        entry->box = {
+            static_cast<int>((item.box.x - layout_box->x) * scale),
+            static_cast<int>((item.box.y - layout_box->y) * scale),
+            static_cast<int>(item.box.width * scale),
+            static_cast<int>(item.box.height * scale),
+        };
+        pixman_region32_intersect_rect(
+            &visible,
+            uncovered,
+            entry->box.x,
+            entry->box.y,
+            entry->box.width,
+            entry->box.height
+        );
+        if (!pixman_region32_not_empty(&visible)) {
+            continue;
+        }
+
+        entry->surface = item.surface;
+        entry->texture = texture;
+        entry->transform = static_cast<enum wl_output_transform>(item.transform);
+        entry->alpha = item.alpha;
+        Surface *surface = reinterpret_cast<Surface*>(item.surface->data);
+        if (surface != NULL) {
+            surface->visible_outputs |= output->mask;
+            output->visible.push_back(surface);
+        }
+
+        pixman_region32_init(&entry->damage);
+        pixman_region32_intersect(&entry->damage, &visible, damage);
+        cover_opaque_region(_wlr_output, entry, uncovered);
+        if (!pixman_region32_not_empty(&entry->damage)) {
+            // Visible, but there's nothing to repaint.
+            pixman_region32_fini(&entry->damage);
+            continue;
+        }
+        if (item.view != last_drawn) {
+            views_drawn++;
+            last_drawn = item.view;
+        }
+        (*count)++;
+    }
+    pixman_region32_fini(&visible);
+    check_newly_hidden(&previous);
+    return views_drawn;
+}
+
+static void render_entry(wlr_output *output,
+                         wlr_renderer *renderer,
+                         RenderEntry *entry) {
+    float matrix[9];
     wlr_matrix_project_box(
         matrix,
-        &box,
-        transform,
+        &entry->box,
+        entry->transform,
         0,
         output->transform_matrix
     );
 
-    wlr_render_texture_with_matrix(rdata->renderer, texture, matrix, 1);
+    int nrects;
+    pixman_box32_t *rects = pixman_region32_rectangles(&entry->damage, &nrects);
+    for (int i = 0; i < nrects; i++) {
+        scissor_output(output, &rects[i]);
+        wlr_render_texture_with_matrix(renderer, entry->texture, matrix, entry->alpha);
+    }
+}
 
-    wlr_surface_send_frame_done(surface, rdata->when);
+// The background only shows through where nothing opaque covers it.
+static void render_background(wlr_output *output,
+                              wlr_renderer *renderer,
+                              pixman_region32_t *damage,
+                              pixman_region32_t *uncovered) {
+    pixman_region32_t background;
+    pixman_region32_init(&background);
+    pixman_region32_intersect(&background, damage, uncovered);
+    float color[4] = {0.3, 0.3, 0.3, 1.0};
+    int nrects;
+    pixman_box32_t *rects = pixman_region32_rectangles(&background, &nrects);
+    for (int i = 0; i < nrects; i++) {
+        scissor_output(output, &rects[i]);
+        wlr_renderer_clear(renderer, color);
+    }
+    pixman_region32_fini(&background);
 }
 
-static void output_frame(wl_listener *listener, void *data) {
-    Output *output = wl_container_of(listener, output, frame);
+static bool output_commit(wlr_output *output) {
+    TRACE_SCOPE("wlr_output_commit");
+    return wlr_output_commit(output);
+}
+
+// Surfaces only get frame callbacks from the one output they're paced by,
+// so that they render at its refresh rate no matter how many outputs they
+// span. Hidden ones are throttled by surfaces_send_hidden_frame_done.
+static void send_frame_done(Output *output, timespec *when) {
+    for (Surface *surface : output->visible) {
+        if (surface_frame_output(surface) & output->mask) {
+            wlr_surface_send_frame_done(surface->surface, when);
+        }
+    }
+}
+
+// Presentation feedback follows the frame callbacks: surfaces hear when the
+// frame about to be committed reaches the screen of the output they're
+// paced by. wlroots fills in the time, refresh and flags from the output's
+// present event.
+static void sample_visible_surfaces(Output *output) {
+    wlr_presentation *presentation = output->server->presentation;
+    for (Surface *surface : output->visible) {
+        if (surface_frame_output(surface) & output->mask) {
+            wlr_presentation_surface_sampled_on_output(
+                presentation,
+                surface->surface,
+                output->output
+            );
+        }
+    }
+}
+
+static void count_surfaces_iterator(wlr_surface *surface,
+                                    int sx, int sy,
+                                    void *data) {
+    if (wlr_surface_has_buffer(surface)) {
+        (*reinterpret_cast<int*>(data))++;
+    }
+}
+
+static bool output_has_software_cursor(wlr_output *output) {
+    wlr_output_cursor *cursor;
+    wl_list_for_each(cursor, &output->cursors, link) {
+        if (cursor->enabled && cursor->visible && cursor != output->hardware_cursor) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Returns the topmost view on the output if it covers the output exactly,
+// which is as fullscreen as views get.
+static View *output_fullscreen_view(Output *output) {
+    View *top = NULL;
+    View *view;
+    wl_list_for_each(view, &output->server->views, link) {
+        if (view->mapped && output_intersects(output, &view->box)) {
+            top = view;
+            break;
+        }
+    }
+    if (top == NULL) {
+        return NULL;
+    }
+
+    const wlr_box *output_box = &output->layout_box;
+    if (top->x != output_box->x || top->y != output_box->y ||
+        top->box.x != output_box->x || top->box.y != output_box->y ||
+        top->box.width != output_box->width || top->box.height != output_box->height) {
+        return NULL;
+    }
+    return top;
+}
+
+// Variable refresh follows fullscreen views, which get to present whenever
+// they're ready, unless the output has it on all the time. The request is
+// part of the next commit, and only made when it changes, since outputs
+// that can't do it just stay disabled. It counts as made once a commit
+// succeeds, so that frames rolled back or failing ask again.
+static void output_update_adaptive_sync(Output *output) {
+    bool enabled = output->adaptive_sync_always || output_fullscreen_view(output) != NULL;
+    output->adaptive_sync_pending = enabled;
+    if (enabled != output->adaptive_sync_requested) {
+        wlr_output_enable_adaptive_sync(output->output, enabled);
+    }
+}
+
+// Returns the surface whose buffer can be shown on the output as-is: the
+// only surface of the topmost view, exactly covering the output, fully
+// opaque and with the output's scale and transform. Anything else showing,
+// including a software cursor, rules direct scanout out, and so does a
+// pending screen capture.
+static wlr_surface *output_scanout_surface(Output *output) {
+    wlr_output *_wlr_output = output->output;
+    if (output_has_software_cursor(_wlr_output)) {
+        return NULL;
+    }
+    if (_wlr_output->attach_render_locks > 0) {
+        // A capture is pending, and it reads back what we render.
+        return NULL;
+    }
+
+    View *top = output_fullscreen_view(output);
+    if (top == NULL) {
+        return NULL;
+    }
+    wlr_surface *surface = top->xdg_surface->surface;
+    const wlr_box *output_box = &output->layout_box;
+    if (surface->current.width != output_box->width ||
+        surface->current.height != output_box->height) {
+        return NULL;
+    }
+    if (surface->buffer == NULL ||
+        surface->current.scale != _wlr_output->scale ||
+        surface->current.transform != _wlr_output->transform) {
+        return NULL;
+    }
+
+    pixman_box32_t rect { 0, 0, surface->current.width, surface->current.height };
+    if (pixman_region32_contains_rectangle(&surface->opaque_region, &rect) != PIXMAN_REGION_IN) {
+        return NULL;
+    }
+
+    int count = 0;
+    wlr_xdg_surface_for_each_surface(top->xdg_surface, count_surfaces_iterator, &count);
+    if (count != 1) {
+        return NULL;
+    }
+    return surface;
+}
+
+// Tries to put the client's buffer on screen without compositing it.
+// committed is false when the buffer on screen was still up to date.
+static bool output_scanout(Output *output, timespec *when, bool *committed) {
+    wlr_output *_wlr_output = output->output;
+    wlr_surface *surface = output_scanout_surface(output);
+    bool scanned_out = false;
+    *committed = false;
+
+    if (surface != NULL) {
+        if (output->scanned_out && !_wlr_output->needs_frame &&
+            !pixman_region32_not_empty(&output->damage->current)) {
+            // Still showing the surface's latest buffer.
+            scanned_out = true;
+        } else {
+            wlr_presentation_surface_sampled_on_output(
+                output->server->presentation,
+                surface,
+                _wlr_output
+            );
+            scanned_out = wlr_output_attach_buffer(_wlr_output, surface->buffer) &&
+                output_commit(_wlr_output);
+            *committed = scanned_out;
+        }
+    }
+
+    if (scanned_out && !output->scanned_out) {
+        wlr_log(WLR_DEBUG, "Output %s: started direct scanout (%llu scanned out, %llu composited)",
+                _wlr_output->name,
+                (unsigned long long)output->stats.frames_scanned_out,
+                (unsigned long long)output->stats.frames_composited);
+    } else if (!scanned_out && output->scanned_out) {
+        wlr_log(WLR_DEBUG, "Output %s: stopped direct scanout (%llu scanned out, %llu composited)",
+                _wlr_output->name,
+                (unsigned long long)output->stats.frames_scanned_out,
+                (unsigned long long)output->stats.frames_composited);
+        // The back buffers don't know what was on screen meanwhile.
+        output_damage_whole(output);
+    }
+    output->scanned_out = scanned_out;
+    if (!scanned_out) {
+        return false;
+    }
+
+    std::vector<Surface*> previous = output->visible;
+    output_clear_visible(output);
+    auto surface_state = reinterpret_cast<Surface*>(surface->data);
+    if (surface_state != NULL) {
+        surface_state->visible_outputs |= output->mask;
+        output->visible.push_back(surface_state);
+    }
+    check_newly_hidden(&previous);
+    send_frame_done(output, when);
+    return true;
+}
+
+enum RenderResult {
+    RENDER_SKIPPED,
+    RENDER_BLOCKED,
+    RENDER_FAILED,
+    RENDER_COMPOSITED,
+    RENDER_SCANNED_OUT,
+};
+
+static RenderResult output_render(Output *output, timespec *now) {
+    wlr_output *_wlr_output = output->output;
     wlr_renderer *renderer = output->server->renderer;
 
-    timespec now;
-    clock_gettime(CLOCK_MONOTONIC, &now);
+    // Interactive move and resize follow the pointer once per refresh.
+    cursor_flush_motion(output->server);
 
-    if (!wlr_output_attach_render(output->output, NULL)) {
-        return;
+    if (transaction_blocks_output(output->server, output)) {
+        // Parts of the output are about to move, and showing them before
+        // every client involved is ready would tear the layout apart.
+        // transaction_apply schedules a frame once it's done.
+        send_frame_done(output, now);
+        return RENDER_BLOCKED;
     }
+
+    output_update_adaptive_sync(output);
+
+    bool scanout_committed;
+    if (output_scanout(output, now, &scanout_committed)) {
+        if (!scanout_committed) {
+            // Drops the variable refresh request along with the frame.
+            wlr_output_rollback(output->output);
+            return RENDER_SKIPPED;
+        }
+        return RENDER_SCANNED_OUT;
+    }
+
+    bool needs_frame;
+    pixman_region32_t damage;
+    pixman_region32_init(&damage);
+    if (!wlr_output_damage_attach_render(output->damage, &needs_frame, &damage)) {
+        pixman_region32_fini(&damage);
+        return RENDER_FAILED;
+    }
+
+    if (!needs_frame) {
+        // Nothing changed since the last frame, so there's nothing to
+        // repaint and nothing to commit. Clients still get their frame
+        // callbacks so that they don't stall waiting for us.
+        wlr_output_rollback(_wlr_output);
+        send_frame_done(output, now);
+        pixman_region32_fini(&damage);
+        return RENDER_SKIPPED;
+    }
+
+    if (output->server->software_render && swrender_needs_whole_frame(output)) {
+        // Nothing of the last frame can be reused on the CPU side.
+        int tr_width, tr_height;
+        wlr_output_transformed_resolution(_wlr_output, &tr_width, &tr_height);
+        pixman_region32_union_rect(&damage, &damage, 0, 0, tr_width, tr_height);
+    }
+
+    frame_arena_reset(&output->frame_arena);
+    const RenderList *render_list = render_list_update(output->server);
+    RenderEntry *entries = frame_arena_array<RenderEntry>(
+        &output->frame_arena,
+        render_list->entries.size()
+    );
+    size_t count;
+    pixman_region32_t uncovered;
+    pixman_region32_init(&uncovered);
+    int views_drawn = collect_visible(output, &damage, entries, &count, &uncovered);
+    histogram_add(&output->stats.views_drawn, views_drawn);
+    histogram_add(&output->stats.surfaces_drawn, count);
+    bool software = output->server->software_render &&
+        swrender_composite(output, entries, count, &uncovered);
+
     // The "effective" resolution can change if you rotate your outputs.
     int width, height;
-    wlr_output_effective_resolution(output->output, &width, &height);
+    wlr_output_effective_resolution(_wlr_output, &width, &height);
 
     wlr_renderer_begin(renderer, width, height);
 
-    float color[4] = {0.3, 0.3, 0.3, 1.0};
-    wlr_renderer_clear(renderer, color);
+    if (software) {
+        swrender_draw(output, &damage);
+    } else {
+        render_background(_wlr_output, renderer, &damage, &uncovered);
+    }
 
-    // Because our view list is ordered front-to-back, we iterate over it backwards.
-    View *view;
-    wl_list_for_each_reverse(view, &output->server->views, link) {
-        if (!view->mapped) {
-            continue;
+    // Entries are ordered front-to-back, so we iterate over them backwards.
+    {
+        TRACE_SCOPE("render_surfaces");
+        for (size_t i = count; i-- > 0;) {
+            if (!software) {
+                render_entry(_wlr_output, renderer, &entries[i]);
+            }
+            pixman_region32_fini(&entries[i].damage);
         }
-        RenderData rdata {
-            output->output,
-            renderer,
-            view,
-            &now,
-        };
-        wlr_xdg_surface_for_each_surface(
-            view->xdg_surface,
-            render_surface,
-            &rdata
-        );
     }
 
     // this function is a no-op when hardware cursors are in use.
-    wlr_output_render_software_cursors(output->output, NULL);
+    wlr_output_render_software_cursors(_wlr_output, &damage);
 
+    wlr_renderer_scissor(renderer, NULL);
     wlr_renderer_end(renderer);
-    wlr_output_commit(output->output);
+
+    send_frame_done(output, now);
+
+    // The output wants its damage in framebuffer coordinates.
+    int tr_width, tr_height;
+    wlr_output_transformed_resolution(_wlr_output, &tr_width, &tr_height);
+    pixman_region32_t frame_damage;
+    pixman_region32_init(&frame_damage);
+    enum wl_output_transform transform = wlr_output_transform_invert(_wlr_output->transform);
+    wlr_region_transform(
+        &frame_damage,
+        &output->damage->current,
+        transform,
+        tr_width,
+        tr_height
+    );
+    wlr_output_set_damage(_wlr_output, &frame_damage);
+    pixman_region32_fini(&frame_damage);
+
+    sample_visible_surfaces(output);
+    bool committed = output_commit(_wlr_output);
+    pixman_region32_fini(&uncovered);
+    pixman_region32_fini(&damage);
+    return committed ? RENDER_COMPOSITED : RENDER_FAILED;
+}
+
+static void output_repaint(Output *output) {
+    TRACE_SCOPE("output_repaint");
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    RenderResult result = output_render(output, &now);
+    timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    int64_t end_nsec = timespec_to_nsec(&end);
+
+    OutputRepaintEvent event;
+    event.output = output;
+    event.usec = (end_nsec - timespec_to_nsec(&now)) / 1000;
+    event.committed = result == RENDER_COMPOSITED || result == RENDER_SCANNED_OUT;
+    event.scanned_out = result == RENDER_SCANNED_OUT;
+    if (event.committed) {
+        output->adaptive_sync_requested = output->adaptive_sync_pending;
+    }
+
+    OutputStats *stats = &output->stats;
+    switch (result) {
+    case RENDER_SKIPPED:
+        stats->frames_skipped++;
+        break;
+    case RENDER_BLOCKED:
+        stats->frames_blocked++;
+        break;
+    case RENDER_FAILED:
+        stats->commit_failures++;
+        wlr_log(WLR_ERROR, "Output %s: failed to commit a frame", output->output->name);
+        break;
+    case RENDER_COMPOSITED:
+        stats->frames_composited++;
+        // Only composited frames tell how long rendering takes.
+        output_record_render_time(output, event.usec);
+        histogram_add(&stats->render_usec, event.usec);
+        break;
+    case RENDER_SCANNED_OUT:
+        stats->frames_scanned_out++;
+        break;
+    }
+    if (event.committed && output->frame_nsec > 0) {
+        histogram_add(&stats->frame_to_commit_usec, (end_nsec - output->frame_nsec) / 1000);
+    }
+    if (event.committed) {
+        stats_output_commit(output, end_nsec);
+    }
+    wl_signal_emit(&output->events.repaint, &event);
+}
+
+static int output_repaint_timer(void *data) {
+    output_repaint(reinterpret_cast<Output*>(data));
+    return 0;
+}
+
+// Returns how many milliseconds to wait before repainting, so that the
+// frame is done just before the next vblank instead of right after the
+// previous one. Input arriving in the meantime makes it into the frame.
+static int output_repaint_delay(Output *output) {
+    // With variable refresh the vblank waits for the frame instead.
+    if (output->max_render_time <= 0 || output->refresh_nsec <= 0 ||
+        output->last_present_nsec <= 0 ||
+        output->output->adaptive_sync_status == WLR_OUTPUT_ADAPTIVE_SYNC_ENABLED) {
+        output->target_present_nsec = 0;
+        return 0;
+    }
+
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    int64_t now_nsec = timespec_to_nsec(&now);
+    int64_t render_nsec = output->max_render_time * 1000000LL;
+    if (now_nsec - output->last_present_nsec > PRESENT_PHASE_MAX_PERIODS * output->refresh_nsec) {
+        output->target_present_nsec = 0;
+        return 0;
+    }
+
+    // The first vblank after the last present that leaves time to render.
+    int64_t target = output->last_present_nsec + output->refresh_nsec;
+    int64_t earliest = now_nsec + render_nsec;
+    if (target < earliest) {
+        int64_t periods = (earliest - target + output->refresh_nsec - 1) / output->refresh_nsec;
+        target += periods * output->refresh_nsec;
+    }
+    output->target_present_nsec = target;
+    return (target - render_nsec - now_nsec) / 1000000;
+}
+
+// Whether a repaint would find nothing to do. Backends that keep sending
+// frame events while nothing gets committed, like the headless and X11
+// ones, then cost next to nothing.
+static bool output_is_idle(Output *output) {
+    if (output->output->needs_frame ||
+        pixman_region32_not_empty(&output->damage->current) ||
+        output->server->motion_pending) {
+        return false;
+    }
+    for (Surface *surface : output->visible) {
+        if ((surface_frame_output(surface) & output->mask) &&
+            !wl_list_empty(&surface->surface->current.frame_callback_list)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void output_frame(wl_listener *listener, void *data) {
+    TRACE_SCOPE("output_frame");
+    Output *output = wl_container_of(listener, output, frame);
+    if (!output->output->enabled || output_is_idle(output)) {
+        return;
+    }
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    output->frame_nsec = timespec_to_nsec(&now);
+    int delay = output_repaint_delay(output);
+    if (delay <= 0) {
+        output_repaint(output);
+        return;
+    }
+    wl_event_source_timer_update(output->repaint_timer, delay);
+}
+
+static void output_present(wl_listener *listener, void *data) {
+    Output *output = wl_container_of(listener, output, present);
+    auto event = reinterpret_cast<wlr_output_event_present*>(data);
+    if (event->when == NULL) {
+        return;
+    }
+    int64_t when = timespec_to_nsec(event->when);
+    if (event->refresh > 0) {
+        output->refresh_nsec = event->refresh;
+    }
+
+    if (output->target_present_nsec > 0 && output->refresh_nsec > 0) {
+        if (when > output->target_present_nsec + output->refresh_nsec / 2) {
+            // We woke up too late for the vblank we aimed at.
+            output->frames_missed++;
+            output->frames_on_time = 0;
+            output->safety_margin_usec += 1000;
+            if (output->safety_margin_usec > output->refresh_nsec / 2000) {
+                output->safety_margin_usec = output->refresh_nsec / 2000;
+            }
+            output_update_max_render_time(output);
+        } else if (++output->frames_on_time >= 120 &&
+                   output->safety_margin_usec > SAFETY_MARGIN_MIN_USEC) {
+            // Win back latency slowly once things are stable again.
+            output->frames_on_time = 0;
+            output->safety_margin_usec -= 500;
+            output_update_max_render_time(output);
+        }
+    }
+    output->target_present_nsec = 0;
+    output->last_present_nsec = when;
+}
+
+static void output_damage_destroy(wl_listener *listener, void *data) {
+    // The damage tracker goes away together with its output.
+    Output *output = wl_container_of(listener, output, damage_destroy);
+    wl_signal_emit(&output->events.destroy, output);
+    arrange_output_destroy(output);
+    output_clear_visible(output);
+    output->server->output_masks &= ~output->mask;
+    wl_event_source_remove(output->repaint_timer);
+    frame_arena_finish(&output->frame_arena);
+    software_frame_finish(&output->software);
+    wl_list_remove(&output->present.link);
+    wl_list_remove(&output->frame.link);
+    wl_list_remove(&output->damage_destroy.link);
+    wl_list_remove(&output->link);
+    delete output;
+}
+
+void output_set_power(Output *output, bool on) {
+    wlr_output *_wlr_output = output->output;
+    if (_wlr_output->enabled == on) {
+        return;
+    }
+    wlr_output_enable(_wlr_output, on);
+    if (!output_commit(_wlr_output)) {
+        wlr_output_rollback(_wlr_output);
+        wlr_log(WLR_ERROR, "Output %s: failed to power %s", _wlr_output->name, on ? "on" : "off");
+        return;
+    }
+    if (on) {
+        // Whatever was in the buffers is long gone.
+        output->scanned_out = false;
+        output_damage_whole(output);
+    }
+}
+
+void output_damage_whole(Output *output) {
+    wlr_output_damage_add_whole(output->damage);
+}
+
+bool output_intersects(Output *output, const wlr_box *box) {
+    wlr_box intersection;
+    return wlr_box_intersection(&intersection, &output->layout_box, box);
+}
+
+void output_damage_box(Output *output, const wlr_box *box) {
+    if (!output_intersects(output, box)) {
+        return;
+    }
+    wlr_box damage_box {
+        box->x - output->layout_box.x,
+        box->y - output->layout_box.y,
+        box->width,
+        box->height,
+    };
+    scale_box(&damage_box, output->output->scale);
+    wlr_output_damage_add_box(output->damage, &damage_box);
+}
+
+void output_damage_surface(Output *output,
+                           wlr_surface *surface,
+                           double lx, double ly,
+                           bool whole) {
+    wlr_box box {
+        static_cast<int>(lx),
+        static_cast<int>(ly),
+        surface->current.width,
+        surface->current.height,
+    };
+    if (whole) {
+        output_damage_box(output, &box);
+        return;
+    }
+    if (!output_intersects(output, &box)) {
+        return;
+    }
+    double ox = lx - output->layout_box.x, oy = ly - output->layout_box.y;
+    float scale = output->output->scale;
+
+    pixman_region32_t damage;
+    pixman_region32_init(&damage);
+    wlr_surface_get_effective_damage(surface, &damage);
+    wlr_region_scale(&damage, &damage, scale);
+    if (ceil(scale) > surface->current.scale) {
+        // Upscaled surfaces are filtered, so a damaged pixel bleeds
+        // into its neighbours.
+        wlr_region_expand(&damage, &damage, ceil(scale) - surface->current.scale);
+    }
+    pixman_region32_translate(&damage, floor(ox * scale), floor(oy * scale));
+    wlr_output_damage_add(output->damage, &damage);
+    pixman_region32_fini(&damage);
 }
 
 void handle_new_output(wl_listener *listener, void *data) {
@@ -133,12 +856,83 @@ void handle_new_output(wl_listener *listener, void *data) {
     Output *output = new Output;
     output->output = _wlr_output;
     output->server = server;
+    output->layout_box = { 0, 0, 0, 0 };
+    output->mask = 0;
+    for (int i = 0; i < 32; i++) {
+        if (!(server->output_masks & (1u << i))) {
+            output->mask = 1u << i;
+            server->output_masks |= output->mask;
+            break;
+        }
+    }
+    output->damage = wlr_output_damage_create(_wlr_output);
     output->frame.notify = output_frame;
-    wl_signal_add(&_wlr_output->events.frame, &output->frame);
+    wl_signal_add(&output->damage->events.frame, &output->frame);
+    output->present.notify = output_present;
+    wl_signal_add(&_wlr_output->events.present, &output->present);
+    output->repaint_timer = wl_event_loop_add_timer(
+        wl_display_get_event_loop(server->display),
+        output_repaint_timer,
+        output
+    );
+    output->refresh_nsec = _wlr_output->refresh > 0 ? 1000000000000LL / _wlr_output->refresh : 0;
+    output->last_present_nsec = 0;
+    output->target_present_nsec = 0;
+    output->render_time_count = 0;
+    output->safety_margin_usec = SAFETY_MARGIN_MIN_USEC;
+    output->max_render_time = 0;
+    output->frames_missed = 0;
+    output->frames_on_time = 0;
+    output->scanned_out = false;
+    output->frame_nsec = 0;
+    output->adaptive_sync_always = false;
+    for (const std::string &name : server->adaptive_sync_outputs) {
+        if (name == _wlr_output->name) {
+            output->adaptive_sync_always = true;
+        }
+    }
+    output->adaptive_sync_requested = false;
+    output->adaptive_sync_pending = false;
+    frame_arena_init(&output->frame_arena);
+    software_frame_init(&output->software);
+    tile_tree_init(&output->tiles);
+    output_stats_init(&output->stats);
+    wl_signal_init(&output->events.repaint);
+    wl_signal_init(&output->events.destroy);
+    output->damage_destroy.notify = output_damage_destroy;
+    wl_signal_add(&output->damage->events.destroy, &output->damage_destroy);
     wl_list_insert(&server->outputs, &output->link);
 
     // The add_auto function arranges outputs from left-to-right in the order
     // they appear. A more sophisticated compositor would let the user configure
     // the arrangement of outputs in the layout.
     wlr_output_layout_add_auto(server->output_layout, _wlr_output);
+
+    if (server->rfb != NULL) {
+        rfb_add_output(server->rfb, output);
+    }
+}
+
+void handle_output_layout_change(wl_listener *listener, void *data) {
+    // Outputs were added, moved, resized, rotated or rescaled. This is the
+    // only place where output layout offsets are looked up, everything else
+    // uses the cached box.
+    Server *server = wl_container_of(listener, server, output_layout_change);
+    Output *output;
+    wl_list_for_each(output, &server->outputs, link) {
+        wlr_box *box = wlr_output_layout_get_box(server->output_layout, output->output);
+        if (box == NULL) {
+            continue;
+        }
+        output->layout_box = *box;
+        output_damage_whole(output);
+    }
+    arrange_outputs(server);
+
+    View *view;
+    wl_list_for_each(view, &server->views, link) {
+        if (view->mapped) {
+            view_update_outputs(view);
+        }
+    }
 }
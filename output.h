@@ -7,15 +7,112 @@
 #ifndef STACKTILE_OUTPUT_H
 #define STACKTILE_OUTPUT_H
 
+#include <stdint.h>
+#include <vector>
+#include "arena.h"
+#include "stats.h"
+#include "swrender.h"
+#include "tiling.h"
+struct wlr_output_damage;
+struct wlr_surface;
+struct wlr_texture;
 struct Server;
+struct Surface;
+
+static const int RENDER_TIME_SAMPLES = 16;
 
 struct Output {
     wl_list link;
     Server *server;
     wlr_output *output;
+    wlr_output_damage *damage;
+    // The output's position and size in the layout, refreshed whenever the
+    // layout changes.
+    wlr_box layout_box;
+    // A bit of its own in Surface::visible_outputs, or 0 past 32 outputs.
+    uint32_t mask;
+    // The surfaces found visible by the last repaint.
+    std::vector<Surface*> visible;
     wl_listener frame;
+    wl_listener present;
+    wl_listener damage_destroy;
+
+    // Repaints are delayed until max_render_time milliseconds before the
+    // next expected vblank. It's derived from the slowest of the recent
+    // frames plus a safety margin that grows when vblanks are missed.
+    wl_event_source *repaint_timer;
+    int64_t refresh_nsec;
+    int64_t last_present_nsec;
+    int64_t target_present_nsec;
+    int render_time_usec[RENDER_TIME_SAMPLES];
+    unsigned int render_time_count;
+    int safety_margin_usec;
+    int max_render_time;
+    int frames_missed;
+    int frames_on_time;
+
+    // Whether the last frame showed a client buffer directly, skipping
+    // composition altogether.
+    bool scanned_out;
+
+    // Whether variable refresh is on even without a fullscreen view, what
+    // the last successful commit asked of the output, and what the frame
+    // being rendered asks.
+    bool adaptive_sync_always;
+    bool adaptive_sync_requested;
+    bool adaptive_sync_pending;
+
+    // When the last frame event came in.
+    int64_t frame_nsec;
+    OutputStats stats;
+    // Scratch memory for the frame being composited.
+    FrameArena frame_arena;
+    // Only used when server->software_render is set.
+    SoftwareFrame software;
+    // The views tiled on the output, see arrange.h.
+    TileTree tiles;
+
+    struct {
+        // Emitted after every repaint with an OutputRepaintEvent.
+        wl_signal repaint;
+        wl_signal destroy;
+    } events;
+};
+
+// A surface that has something to draw on this output, with the part of the
+// damage it's responsible for repainting.
+// They only live for a frame, in the output's frame arena.
+struct RenderEntry {
+    wlr_surface *surface;
+    wlr_texture *texture;
+    // Output-buffer coordinates.
+    wlr_box box;
+    enum wl_output_transform transform;
+    float alpha;
+    pixman_region32_t damage;
+};
+
+struct OutputRepaintEvent {
+    Output *output;
+    // Time from the start of the repaint to the end of the commit.
+    int usec;
+    bool committed;
+    bool scanned_out;
 };
 
 void handle_new_output(wl_listener *listener, void *data);
+void handle_output_layout_change(wl_listener *listener, void *data);
+
+// Turns the output on or off, DPMS style.
+void output_set_power(Output *output, bool on);
+
+// Damage functions take layout coordinates.
+void output_damage_whole(Output *output);
+void output_damage_box(Output *output, const wlr_box *box);
+bool output_intersects(Output *output, const wlr_box *box);
+void output_damage_surface(Output *output,
+                           wlr_surface *surface,
+                           double lx, double ly,
+                           bool whole);
 
 #endif /* STACKTILE_OUTPUT_H */
@@ -0,0 +1,104 @@
+// Copyright © 2020 Mateus Carmo Martins de Freitas Barbosa
+//
+// This program is licensed under the GNU General Public License, version 3.
+// See LICENSE.txt.
+//
+
+#include <algorithm>
+#include <wayland-server-core.h>
+
+extern "C" {
+#define static
+
+#include <wlr/types/wlr_box.h>
+#include <wlr/types/wlr_output.h>
+#include <wlr/types/wlr_surface.h>
+#include <wlr/types/wlr_xdg_shell.h>
+
+#undef static
+}
+
+#include "renderlist.h"
+#include "server.h"
+#include "trace.h"
+#include "view.h"
+
+void render_list_init(RenderList *list) {
+    list->dirty = true;
+}
+
+void render_list_invalidate_view(View *view) {
+    view->render_dirty = true;
+    view->server->render_list.dirty = true;
+}
+
+void render_list_invalidate(Server *server) {
+    server->render_list.dirty = true;
+}
+
+static RenderListEntry make_entry(View *view, wlr_surface *surface, int sx, int sy) {
+    return {
+        surface,
+        view,
+        { view->x + sx, view->y + sy, surface->current.width, surface->current.height },
+        wlr_output_transform_invert(surface->current.transform),
+        1.0f,
+    };
+}
+
+bool render_list_view_entry_matches(View *view, size_t index, wlr_surface *surface, int sx, int sy) {
+    const std::vector<RenderListEntry> &entries = view->render_entries;
+    if (view->render_dirty || index >= entries.size()) {
+        return false;
+    }
+    // Entries are front-to-back.
+    const RenderListEntry *entry = &entries[entries.size() - 1 - index];
+    RenderListEntry current = make_entry(view, surface, sx, sy);
+    return entry->surface == current.surface &&
+        entry->box.x == current.box.x && entry->box.y == current.box.y &&
+        entry->box.width == current.box.width && entry->box.height == current.box.height &&
+        entry->transform == current.transform;
+}
+
+// Surfaces without a buffer get an entry too, so that attaching one only
+// changes their size. Drawing skips them.
+static void collect_surface_iterator(wlr_surface *surface,
+                                     int sx, int sy,
+                                     void *data) {
+    auto view = reinterpret_cast<View*>(data);
+    view->render_entries.push_back(make_entry(view, surface, sx, sy));
+}
+
+static void view_rebuild_render_entries(View *view) {
+    view->render_entries.clear();
+    wlr_xdg_surface_for_each_surface(view->xdg_surface, collect_surface_iterator, view);
+    // The surface tree is iterated back-to-front.
+    std::reverse(view->render_entries.begin(), view->render_entries.end());
+    view->render_dirty = false;
+}
+
+const RenderList *render_list_update(Server *server) {
+    RenderList *list = &server->render_list;
+    if (!list->dirty) {
+        return list;
+    }
+    TRACE_SCOPE("render_list_update");
+
+    list->entries.clear();
+    View *view;
+    wl_list_for_each(view, &server->views, link) {
+        if (!view->mapped) {
+            continue;
+        }
+        if (view->render_dirty) {
+            view_rebuild_render_entries(view);
+        }
+        list->entries.insert(
+            list->entries.end(),
+            view->render_entries.begin(),
+            view->render_entries.end()
+        );
+    }
+    list->dirty = false;
+    return list;
+}
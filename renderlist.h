@@ -0,0 +1,55 @@
+// Copyright © 2020 Mateus Carmo Martins de Freitas Barbosa
+//
+// This program is licensed under the GNU General Public License, version 3.
+// See LICENSE.txt.
+//
+
+#ifndef STACKTILE_RENDERLIST_H
+#define STACKTILE_RENDERLIST_H
+
+#include <stddef.h>
+#include <vector>
+struct wlr_surface;
+struct Server;
+struct View;
+
+// The texture is looked up when drawing, since a commit may replace it
+// without changing anything else.
+struct RenderListEntry {
+    wlr_surface *surface;
+    View *view;
+    // Layout coordinates.
+    wlr_box box;
+    // The inverse of the surface's buffer transform, as an enum
+    // wl_output_transform.
+    int transform;
+    float alpha;
+};
+
+// The surfaces of every mapped view, front-to-back, in a flat array that
+// outputs scan once per frame. Each view keeps its own entries, which are
+// only rebuilt after its surface tree or geometry changed. The whole list
+// is concatenated again when any view's entries or the stacking order
+// changed.
+struct RenderList {
+    std::vector<RenderListEntry> entries;
+    bool dirty;
+};
+
+void render_list_init(RenderList *list);
+
+// The view's surface tree or geometry changed.
+void render_list_invalidate_view(View *view);
+// Views were mapped, unmapped or restacked.
+void render_list_invalidate(Server *server);
+
+// Whether the surface, at sx, sy in the view, is what the view's entry
+// for the index-th surface of its tree, counted back-to-front, shows.
+// Lets a walk of the tree tell whether the entries are still good.
+bool render_list_view_entry_matches(View *view, size_t index, wlr_surface *surface, int sx, int sy);
+
+// Entries may point to destroyed surfaces until the list is updated, so it
+// must be updated before being used.
+const RenderList *render_list_update(Server *server);
+
+#endif /* STACKTILE_RENDERLIST_H */
@@ -0,0 +1,1050 @@
+// Copyright © 2020 Mateus Carmo Martins de Freitas Barbosa
+//
+// This program is licensed under the GNU General Public License, version 3.
+// See LICENSE.txt.
+//
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <linux/input-event-codes.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <vector>
+#include <wayland-server-core.h>
+#include <xkbcommon/xkbcommon.h>
+
+extern "C" {
+#define static
+
+#include <wlr/backend.h>
+#include <wlr/backend/headless.h>
+#include <wlr/backend/multi.h>
+#include <wlr/render/wlr_renderer.h>
+#include <wlr/types/wlr_box.h>
+#include <wlr/types/wlr_input_device.h>
+#include <wlr/types/wlr_keyboard.h>
+#include <wlr/types/wlr_output.h>
+#include <wlr/types/wlr_output_layout.h>
+#include <wlr/types/wlr_pointer.h>
+#include <wlr/util/log.h>
+
+#undef static
+}
+
+#include "output.h"
+#include "rfb.h"
+#include "server.h"
+#include "swrender.h"
+#include "trace.h"
+
+static const int TILE_SIZE = 64;
+// Viewers can't tell us anything useful in a message longer than this.
+static const uint32_t MAX_CUT_TEXT = 1 << 20;
+
+static const int32_t ENCODING_RAW = 0;
+static const int32_t ENCODING_DESKTOP_SIZE = -223;
+
+enum RfbClientState {
+    RFB_CLIENT_VERSION,
+    RFB_CLIENT_SECURITY,
+    RFB_CLIENT_INIT,
+    RFB_CLIENT_NORMAL,
+};
+
+struct RfbPixelFormat {
+    uint8_t bits_per_pixel;
+    uint8_t depth;
+    uint8_t big_endian;
+    uint8_t true_colour;
+    uint16_t red_max, green_max, blue_max;
+    uint8_t red_shift, green_shift, blue_shift;
+};
+
+// ARGB8888 as it is in memory, which is what gets read back.
+static const RfbPixelFormat NATIVE_FORMAT = { 32, 24, 0, 1, 255, 255, 255, 16, 8, 0 };
+
+struct RfbOutput {
+    wl_list link;
+    Rfb *rfb;
+    Output *output;
+    int listen_fd;
+    wl_event_source *listen_source;
+    // RfbClient::link
+    wl_list clients;
+
+    // The output's latest frame, either the software compositor's, or
+    // read back from the renderer into readback.
+    const uint32_t *frame;
+    int width, height;
+    std::vector<uint32_t> readback;
+    std::vector<uint32_t> scratch;
+    bool readback_valid;
+    bool zero_copy;
+    bool y_invert;
+    // Whether y_invert was told by a read of the whole frame yet.
+    bool y_invert_known;
+    // With zero copy, the tiles under the software cursor, which only the
+    // renderer's frame has, so they're read back into readback.
+    std::vector<uint8_t> tile_read_back;
+    // Hashes of the frame's tiles, computed when someone needs them.
+    int tiles_x, tiles_y;
+    std::vector<uint64_t> tile_hashes;
+    std::vector<uint8_t> tile_hash_valid;
+
+    wl_listener precommit;
+    wl_listener repaint;
+    wl_listener destroy;
+};
+
+struct RfbClient {
+    wl_list link;
+    RfbOutput *output;
+    int fd;
+    wl_event_source *source;
+    RfbClientState state;
+    int minor_version;
+    std::vector<uint8_t> in;
+    std::vector<uint8_t> out;
+    size_t out_offset;
+
+    RfbPixelFormat format;
+    bool desktop_size;
+    bool resized;
+    // Tiles damaged since they were last sent, and the hash of what was
+    // sent, 0 for nothing yet.
+    std::vector<uint8_t> dirty;
+    std::vector<uint64_t> sent;
+    bool update_requested;
+    pixman_box32_t requested;
+    uint8_t buttons;
+    int pointer_x, pointer_y;
+};
+
+static uint32_t now_msec() {
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+static uint16_t get_u16(const uint8_t *p) {
+    return p[0] << 8 | p[1];
+}
+
+static uint32_t get_u32(const uint8_t *p) {
+    return static_cast<uint32_t>(p[0]) << 24 | p[1] << 16 | p[2] << 8 | p[3];
+}
+
+static void put_u8(std::vector<uint8_t> *out, uint8_t value) {
+    out->push_back(value);
+}
+
+static void put_u16(std::vector<uint8_t> *out, uint16_t value) {
+    out->push_back(value >> 8);
+    out->push_back(value);
+}
+
+static void put_u32(std::vector<uint8_t> *out, uint32_t value) {
+    put_u16(out, value >> 16);
+    put_u16(out, value);
+}
+
+static void put_pixel_format(std::vector<uint8_t> *out, const RfbPixelFormat *format) {
+    put_u8(out, format->bits_per_pixel);
+    put_u8(out, format->depth);
+    put_u8(out, format->big_endian);
+    put_u8(out, format->true_colour);
+    put_u16(out, format->red_max);
+    put_u16(out, format->green_max);
+    put_u16(out, format->blue_max);
+    put_u8(out, format->red_shift);
+    put_u8(out, format->green_shift);
+    put_u8(out, format->blue_shift);
+    out->insert(out->end(), 3, 0);
+}
+
+static int tile_count(RfbOutput *output) {
+    return output->tiles_x * output->tiles_y;
+}
+
+// Where the tile's pixel at x, y is served from.
+static const uint32_t *tile_pixels(RfbOutput *output, int tile, int x, int y) {
+    const uint32_t *frame = output->tile_read_back[tile] ? output->readback.data() : output->frame;
+    return frame + static_cast<size_t>(y) * output->width + x;
+}
+
+static void client_destroy(RfbClient *client) {
+    RfbOutput *output = client->output;
+    wl_event_source_remove(client->source);
+    close(client->fd);
+    wl_list_remove(&client->link);
+    delete client;
+    if (wl_list_empty(&output->clients)) {
+        wlr_output_lock_attach_render(output->output->output, false);
+    }
+}
+
+static bool client_flush(RfbClient *client) {
+    while (client->out_offset < client->out.size()) {
+        // A viewer that went away fails with EPIPE rather than raising
+        // SIGPIPE, which would kill the compositor.
+        ssize_t n = send(
+            client->fd,
+            client->out.data() + client->out_offset,
+            client->out.size() - client->out_offset,
+            MSG_NOSIGNAL
+        );
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                break;
+            }
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        client->out_offset += n;
+    }
+    uint32_t mask = WL_EVENT_READABLE;
+    if (client->out_offset == client->out.size()) {
+        client->out.clear();
+        client->out_offset = 0;
+    } else {
+        mask |= WL_EVENT_WRITABLE;
+    }
+    wl_event_source_fd_update(client->source, mask);
+    return true;
+}
+
+// Forgets everything the client was sent.
+static void client_reset_tiles(RfbClient *client) {
+    int count = tile_count(client->output);
+    client->dirty.assign(count, 1);
+    client->sent.assign(count, 0);
+}
+
+static uint64_t tile_hash(RfbOutput *output, int tile) {
+    if (output->tile_hash_valid[tile]) {
+        return output->tile_hashes[tile];
+    }
+    int x1 = tile % output->tiles_x * TILE_SIZE, y1 = tile / output->tiles_x * TILE_SIZE;
+    int x2 = std::min(x1 + TILE_SIZE, output->width), y2 = std::min(y1 + TILE_SIZE, output->height);
+    // FNV-1a over whole pixels, which is plenty to tell frames apart.
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (int y = y1; y < y2; y++) {
+        const uint32_t *row = tile_pixels(output, tile, x1, y);
+        for (int x = 0; x < x2 - x1; x++) {
+            hash = (hash ^ (row[x] & 0x00ffffff)) * 0x100000001b3ULL;
+        }
+    }
+    // 0 is for tiles never sent.
+    hash |= 1;
+    output->tile_hashes[tile] = hash;
+    output->tile_hash_valid[tile] = 1;
+    return hash;
+}
+
+static void put_pixels(RfbClient *client, const uint32_t *row, int count) {
+    const RfbPixelFormat *format = &client->format;
+    std::vector<uint8_t> *out = &client->out;
+    size_t start = out->size();
+    out->resize(start + count * 4);
+    uint8_t *dst = out->data() + start;
+    if (memcmp(format, &NATIVE_FORMAT, sizeof(*format)) == 0) {
+        memcpy(dst, row, count * 4);
+        return;
+    }
+    for (int i = 0; i < count; i++) {
+        uint32_t pixel = row[i];
+        uint32_t value = ((pixel >> 16) & 0xff) << format->red_shift |
+            ((pixel >> 8) & 0xff) << format->green_shift |
+            (pixel & 0xff) << format->blue_shift;
+        if (format->big_endian) {
+            value = __builtin_bswap32(value);
+        }
+        memcpy(dst + i * 4, &value, 4);
+    }
+}
+
+// Sends whatever changed in the requested area, or keeps the request
+// pending until something does.
+static bool client_send_update(RfbClient *client) {
+    RfbOutput *output = client->output;
+    if (!client->update_requested || output->frame == NULL) {
+        return true;
+    }
+
+    std::vector<int> tiles;
+    for (int tile = 0; tile < tile_count(output); tile++) {
+        if (!client->dirty[tile]) {
+            continue;
+        }
+        int x = tile % output->tiles_x * TILE_SIZE, y = tile / output->tiles_x * TILE_SIZE;
+        if (x >= client->requested.x2 || x + TILE_SIZE <= client->requested.x1 ||
+            y >= client->requested.y2 || y + TILE_SIZE <= client->requested.y1) {
+            continue;
+        }
+        client->dirty[tile] = 0;
+        uint64_t hash = tile_hash(output, tile);
+        if (hash == client->sent[tile]) {
+            // Damaged, but it ended up the same.
+            continue;
+        }
+        client->sent[tile] = hash;
+        tiles.push_back(tile);
+    }
+    if (tiles.empty() && !client->resized) {
+        return true;
+    }
+
+    TRACE_SCOPE("rfb_send_update");
+    std::vector<uint8_t> *out = &client->out;
+    put_u8(out, 0);
+    put_u8(out, 0);
+    put_u16(out, tiles.size() + (client->resized ? 1 : 0));
+    if (client->resized) {
+        put_u16(out, 0);
+        put_u16(out, 0);
+        put_u16(out, output->width);
+        put_u16(out, output->height);
+        put_u32(out, ENCODING_DESKTOP_SIZE);
+        client->resized = false;
+    }
+    for (int tile : tiles) {
+        int x1 = tile % output->tiles_x * TILE_SIZE, y1 = tile / output->tiles_x * TILE_SIZE;
+        int x2 = std::min(x1 + TILE_SIZE, output->width), y2 = std::min(y1 + TILE_SIZE, output->height);
+        put_u16(out, x1);
+        put_u16(out, y1);
+        put_u16(out, x2 - x1);
+        put_u16(out, y2 - y1);
+        put_u32(out, ENCODING_RAW);
+        for (int y = y1; y < y2; y++) {
+            put_pixels(client, tile_pixels(output, tile, x1, y), x2 - x1);
+        }
+    }
+    client->update_requested = false;
+    return client_flush(client);
+}
+
+static bool handle_set_pixel_format(RfbClient *client, const uint8_t *message) {
+    const uint8_t *p = message + 4;
+    RfbPixelFormat format;
+    memset(&format, 0, sizeof(format));
+    format.bits_per_pixel = p[0];
+    format.depth = p[1];
+    format.big_endian = p[2] != 0;
+    format.true_colour = p[3] != 0;
+    format.red_max = get_u16(p + 4);
+    format.green_max = get_u16(p + 6);
+    format.blue_max = get_u16(p + 8);
+    format.red_shift = p[10];
+    format.green_shift = p[11];
+    format.blue_shift = p[12];
+    if (format.bits_per_pixel != 32 || !format.true_colour ||
+        format.red_max != 255 || format.green_max != 255 || format.blue_max != 255 ||
+        format.red_shift > 24 || format.green_shift > 24 || format.blue_shift > 24) {
+        wlr_log(WLR_ERROR, "RFB: unsupported pixel format (%d bpp)", format.bits_per_pixel);
+        return false;
+    }
+    client->format = format;
+    // Nothing sent before is any good in the new format.
+    client_reset_tiles(client);
+    return true;
+}
+
+static void handle_update_request(RfbClient *client, const uint8_t *message) {
+    RfbOutput *output = client->output;
+    bool incremental = message[1] != 0;
+    int x = get_u16(message + 2), y = get_u16(message + 4);
+    int width = get_u16(message + 6), height = get_u16(message + 8);
+    client->requested = { x, y, x + width, y + height };
+    client->update_requested = true;
+    if (incremental) {
+        return;
+    }
+    for (int tile = 0; tile < tile_count(output); tile++) {
+        int tx = tile % output->tiles_x * TILE_SIZE, ty = tile / output->tiles_x * TILE_SIZE;
+        if (tx < x + width && tx + TILE_SIZE > x && ty < y + height && ty + TILE_SIZE > y) {
+            client->dirty[tile] = 1;
+            client->sent[tile] = 0;
+        }
+    }
+}
+
+static uint32_t keysym_to_keycode(Rfb *rfb, uint32_t keysym) {
+    xkb_keymap *keymap = rfb->keyboard->keyboard->keymap;
+    if (keymap == NULL) {
+        return 0;
+    }
+    if (keymap != rfb->keycodes_keymap) {
+        // Viewers press shift themselves, so the first level a keysym
+        // shows up on is all that matters, and the lowest one wins.
+        rfb->keycodes.clear();
+        rfb->keycodes_keymap = keymap;
+        xkb_keycode_t min = xkb_keymap_min_keycode(keymap), max = xkb_keymap_max_keycode(keymap);
+        for (xkb_level_index_t level = 0; level < 4; level++) {
+            for (xkb_keycode_t keycode = min; keycode <= max; keycode++) {
+                if (level >= xkb_keymap_num_levels_for_key(keymap, keycode, 0)) {
+                    continue;
+                }
+                const xkb_keysym_t *syms;
+                int nsyms = xkb_keymap_key_get_syms_by_level(keymap, keycode, 0, level, &syms);
+                for (int i = 0; i < nsyms; i++) {
+                    rfb->keycodes.emplace(syms[i], keycode);
+                }
+            }
+        }
+    }
+    auto it = rfb->keycodes.find(keysym);
+    return it != rfb->keycodes.end() ? it->second : 0;
+}
+
+static void handle_key_event(RfbClient *client, const uint8_t *message) {
+    Rfb *rfb = client->output->rfb;
+    uint32_t keysym = get_u32(message + 4);
+    uint32_t keycode = keysym_to_keycode(rfb, keysym);
+    if (keycode == 0) {
+        wlr_log(WLR_DEBUG, "RFB: no key for keysym 0x%x", keysym);
+        return;
+    }
+    wlr_event_keyboard_key event;
+    event.time_msec = now_msec();
+    // The keymap's keycodes are evdev's plus 8.
+    event.keycode = keycode - 8;
+    event.update_state = true;
+    event.state = message[1] ? WLR_KEY_PRESSED : WLR_KEY_RELEASED;
+    wlr_keyboard_notify_key(rfb->keyboard->keyboard, &event);
+}
+
+static void handle_pointer_event(RfbClient *client, const uint8_t *message) {
+    static const uint32_t buttons[] = { BTN_LEFT, BTN_MIDDLE, BTN_RIGHT };
+    RfbOutput *output = client->output;
+    Rfb *rfb = output->rfb;
+    wlr_input_device *device = rfb->pointer;
+    wlr_pointer *pointer = device->pointer;
+    uint8_t mask = message[1];
+    int x = get_u16(message + 2), y = get_u16(message + 4);
+    uint32_t time = now_msec();
+
+    wlr_box *layout = wlr_output_layout_get_box(rfb->server->output_layout, NULL);
+    if ((x != client->pointer_x || y != client->pointer_y) &&
+        layout != NULL && layout->width > 0 && layout->height > 0) {
+        // The pointer isn't tied to any output, so its absolute motion
+        // spans the whole layout.
+        const wlr_box *box = &output->output->layout_box;
+        float scale = output->output->output->scale;
+        wlr_event_pointer_motion_absolute event;
+        event.device = device;
+        event.time_msec = time;
+        event.x = (box->x + x / scale - layout->x) / layout->width;
+        event.y = (box->y + y / scale - layout->y) / layout->height;
+        wl_signal_emit(&pointer->events.motion_absolute, &event);
+        client->pointer_x = x;
+        client->pointer_y = y;
+    }
+
+    uint8_t changed = mask ^ client->buttons;
+    for (int i = 0; i < 3; i++) {
+        if (!(changed & (1 << i))) {
+            continue;
+        }
+        wlr_event_pointer_button event;
+        event.device = device;
+        event.time_msec = time;
+        event.button = buttons[i];
+        event.state = mask & (1 << i) ? WLR_BUTTON_PRESSED : WLR_BUTTON_RELEASED;
+        wl_signal_emit(&pointer->events.button, &event);
+    }
+    // Buttons 4 to 7 are the wheel, a step on every press.
+    for (int i = 3; i < 7; i++) {
+        if (!(changed & mask & (1 << i))) {
+            continue;
+        }
+        wlr_event_pointer_axis event;
+        event.device = device;
+        event.time_msec = time;
+        event.source = WLR_AXIS_SOURCE_WHEEL;
+        event.orientation = i < 5 ? WLR_AXIS_ORIENTATION_VERTICAL : WLR_AXIS_ORIENTATION_HORIZONTAL;
+        event.delta_discrete = i % 2 ? -1 : 1;
+        event.delta = event.delta_discrete * 15;
+        wl_signal_emit(&pointer->events.axis, &event);
+    }
+    client->buttons = mask;
+    wl_signal_emit(&pointer->events.frame, pointer);
+}
+
+// Handles as many complete messages as there are in the input, returning
+// how many bytes were consumed, or -1 to drop the client.
+static ssize_t client_handle_message(RfbClient *client, const uint8_t *data, size_t size) {
+    RfbOutput *output = client->output;
+    std::vector<uint8_t> *out = &client->out;
+    switch (client->state) {
+    case RFB_CLIENT_VERSION: {
+        if (size < 12) {
+            return 0;
+        }
+        if (memcmp(data, "RFB 003.", 8) != 0) {
+            return -1;
+        }
+        client->minor_version = atoi(std::string(reinterpret_cast<const char*>(data) + 8, 3).c_str());
+        if (client->minor_version >= 7) {
+            // One security type: none.
+            put_u8(out, 1);
+            put_u8(out, 1);
+            client->state = RFB_CLIENT_SECURITY;
+        } else {
+            put_u32(out, 1);
+            client->state = RFB_CLIENT_INIT;
+        }
+        return 12;
+    }
+    case RFB_CLIENT_SECURITY:
+        if (size < 1) {
+            return 0;
+        }
+        if (data[0] != 1) {
+            return -1;
+        }
+        if (client->minor_version >= 8) {
+            put_u32(out, 0);
+        }
+        client->state = RFB_CLIENT_INIT;
+        return 1;
+    case RFB_CLIENT_INIT: {
+        if (size < 1) {
+            return 0;
+        }
+        // Every viewer shares the output, whatever it asks for.
+        std::string name = std::string("stacktile ") + output->output->output->name;
+        put_u16(out, output->width);
+        put_u16(out, output->height);
+        put_pixel_format(out, &NATIVE_FORMAT);
+        put_u32(out, name.size());
+        out->insert(out->end(), name.begin(), name.end());
+        client->state = RFB_CLIENT_NORMAL;
+        return 1;
+    }
+    case RFB_CLIENT_NORMAL:
+        break;
+    }
+
+    if (size < 1) {
+        return 0;
+    }
+    switch (data[0]) {
+    case 0:
+        if (size < 20) {
+            return 0;
+        }
+        return handle_set_pixel_format(client, data) ? 20 : -1;
+    case 2: {
+        if (size < 4) {
+            return 0;
+        }
+        size_t count = get_u16(data + 2);
+        if (size < 4 + count * 4) {
+            return 0;
+        }
+        client->desktop_size = false;
+        for (size_t i = 0; i < count; i++) {
+            if (static_cast<int32_t>(get_u32(data + 4 + i * 4)) == ENCODING_DESKTOP_SIZE) {
+                client->desktop_size = true;
+            }
+        }
+        // Raw is all we send, and every viewer takes it.
+        return 4 + count * 4;
+    }
+    case 3:
+        if (size < 10) {
+            return 0;
+        }
+        handle_update_request(client, data);
+        return 10;
+    case 4:
+        if (size < 8) {
+            return 0;
+        }
+        handle_key_event(client, data);
+        return 8;
+    case 5:
+        if (size < 6) {
+            return 0;
+        }
+        handle_pointer_event(client, data);
+        return 6;
+    case 6: {
+        if (size < 8) {
+            return 0;
+        }
+        uint32_t length = get_u32(data + 4);
+        if (length > MAX_CUT_TEXT) {
+            return -1;
+        }
+        if (size < 8 + length) {
+            return 0;
+        }
+        // The clipboard isn't shared.
+        return 8 + length;
+    }
+    default:
+        wlr_log(WLR_ERROR, "RFB: unknown message type %d", data[0]);
+        return -1;
+    }
+}
+
+static int client_handle_fd(int fd, uint32_t mask, void *data) {
+    auto client = reinterpret_cast<RfbClient*>(data);
+    if (mask & (WL_EVENT_HANGUP | WL_EVENT_ERROR)) {
+        client_destroy(client);
+        return 0;
+    }
+    if (mask & WL_EVENT_WRITABLE && !client_flush(client)) {
+        client_destroy(client);
+        return 0;
+    }
+    if (!(mask & WL_EVENT_READABLE)) {
+        return 0;
+    }
+
+    uint8_t buffer[4096];
+    for (;;) {
+        ssize_t n = read(fd, buffer, sizeof(buffer));
+        if (n == 0) {
+            client_destroy(client);
+            return 0;
+        }
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                break;
+            }
+            client_destroy(client);
+            return 0;
+        }
+        client->in.insert(client->in.end(), buffer, buffer + n);
+    }
+
+    size_t consumed = 0;
+    for (;;) {
+        ssize_t n = client_handle_message(
+            client,
+            client->in.data() + consumed,
+            client->in.size() - consumed
+        );
+        if (n < 0) {
+            client_destroy(client);
+            return 0;
+        }
+        if (n == 0) {
+            break;
+        }
+        consumed += n;
+    }
+    client->in.erase(client->in.begin(), client->in.begin() + consumed);
+
+    if (!client_send_update(client) || !client_flush(client)) {
+        client_destroy(client);
+    }
+    return 0;
+}
+
+static int output_handle_accept(int fd, uint32_t mask, void *data) {
+    auto output = reinterpret_cast<RfbOutput*>(data);
+    int client_fd = accept4(fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (client_fd < 0) {
+        return 0;
+    }
+    int one = 1;
+    setsockopt(client_fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    RfbClient *client = new RfbClient;
+    client->output = output;
+    client->fd = client_fd;
+    client->state = RFB_CLIENT_VERSION;
+    client->minor_version = 8;
+    client->out_offset = 0;
+    client->format = NATIVE_FORMAT;
+    client->desktop_size = false;
+    client->resized = false;
+    client->update_requested = false;
+    client->requested = { 0, 0, 0, 0 };
+    client->buttons = 0;
+    client->pointer_x = -1;
+    client->pointer_y = -1;
+    client_reset_tiles(client);
+    client->source = wl_event_loop_add_fd(
+        wl_display_get_event_loop(output->rfb->server->display),
+        client_fd,
+        WL_EVENT_READABLE,
+        client_handle_fd,
+        client
+    );
+    if (wl_list_empty(&output->clients)) {
+        // Frames must be rendered, not scanned out, to be read back.
+        wlr_output_lock_attach_render(output->output->output, true);
+        output_damage_whole(output->output);
+    }
+    wl_list_insert(&output->clients, &client->link);
+
+    static const char version[] = "RFB 003.008\n";
+    client->out.insert(client->out.end(), version, version + 12);
+    if (!client_flush(client)) {
+        client_destroy(client);
+    }
+    return 0;
+}
+
+static void output_resize(RfbOutput *output, int width, int height) {
+    output->width = width;
+    output->height = height;
+    output->tiles_x = (width + TILE_SIZE - 1) / TILE_SIZE;
+    output->tiles_y = (height + TILE_SIZE - 1) / TILE_SIZE;
+    output->tile_hashes.assign(tile_count(output), 0);
+    output->tile_hash_valid.assign(tile_count(output), 0);
+    output->tile_read_back.assign(tile_count(output), 0);
+    output->readback.assign(static_cast<size_t>(width) * height, 0);
+    output->readback_valid = false;
+    output->frame = NULL;
+    output->y_invert_known = false;
+
+    RfbClient *client, *tmp;
+    wl_list_for_each_safe(client, tmp, &output->clients, link) {
+        if (client->state != RFB_CLIENT_NORMAL) {
+            // The new size goes out with ServerInit.
+            client_reset_tiles(client);
+        } else if (client->desktop_size) {
+            client_reset_tiles(client);
+            client->resized = true;
+        } else {
+            wlr_log(WLR_INFO, "RFB: output resized, dropping a viewer that can't follow");
+            client_destroy(client);
+        }
+    }
+}
+
+// Reads the damaged part of the frame back from the renderer.
+static bool output_read_back(RfbOutput *output, pixman_region32_t *damage) {
+    wlr_output *_wlr_output = output->output->output;
+    wlr_renderer *renderer = output->rfb->server->renderer;
+    enum wl_shm_format format;
+    if (!wlr_output_preferred_read_format(_wlr_output, &format) ||
+        (format != WL_SHM_FORMAT_ARGB8888 && format != WL_SHM_FORMAT_XRGB8888)) {
+        wlr_log(WLR_ERROR, "RFB: output %s can't be read back as ARGB", _wlr_output->name);
+        return false;
+    }
+
+    int nrects;
+    pixman_box32_t *rects = pixman_region32_rectangles(damage, &nrects);
+    for (int i = 0; i < nrects; i++) {
+        int width = rects[i].x2 - rects[i].x1, height = rects[i].y2 - rects[i].y1;
+        output->scratch.resize(static_cast<size_t>(width) * height);
+        // Renderers that read bottom-up expect bottom-up coordinates too.
+        // The first read is always of the whole frame, which tells.
+        int y = output->y_invert ? output->height - rects[i].y2 : rects[i].y1;
+        uint32_t flags = 0;
+        if (!wlr_renderer_read_pixels(
+                renderer,
+                format,
+                &flags,
+                width * 4,
+                width,
+                height,
+                rects[i].x1,
+                y,
+                0,
+                0,
+                output->scratch.data())) {
+            return false;
+        }
+        output->y_invert = flags & WLR_RENDERER_READ_PIXELS_Y_INVERT;
+        output->y_invert_known = true;
+        for (int row = 0; row < height; row++) {
+            int src_row = output->y_invert ? height - 1 - row : row;
+            memcpy(
+                &output->readback[static_cast<size_t>(rects[i].y1 + row) * output->width + rects[i].x1],
+                &output->scratch[static_cast<size_t>(src_row) * width],
+                width * 4
+            );
+        }
+    }
+    return true;
+}
+
+// The software frame has no software cursor, which the renderer draws on
+// top of it, so the tiles under it are read back instead. Tiles the cursor
+// left or entered are added to damage. When reading back fails, viewers
+// get the frame without the cursor.
+static void output_read_back_cursors(RfbOutput *output, pixman_region32_t *damage) {
+    wlr_output *_wlr_output = output->output->output;
+    pixman_region32_t tiles;
+    pixman_region32_init(&tiles);
+    for (int tile = 0; tile < tile_count(output); tile++) {
+        if (output->tile_read_back[tile]) {
+            int x = tile % output->tiles_x * TILE_SIZE, y = tile / output->tiles_x * TILE_SIZE;
+            pixman_region32_union_rect(damage, damage, x, y, TILE_SIZE, TILE_SIZE);
+            output->tile_read_back[tile] = 0;
+        }
+    }
+
+    int width, height;
+    wlr_output_transformed_resolution(_wlr_output, &width, &height);
+    wlr_output_cursor *cursor;
+    wl_list_for_each(cursor, &_wlr_output->cursors, link) {
+        if (!cursor->enabled || !cursor->visible || cursor == _wlr_output->hardware_cursor) {
+            continue;
+        }
+        // Cursors are placed in transformed coordinates, frames aren't.
+        wlr_box box;
+        box.x = cursor->x - cursor->hotspot_x;
+        box.y = cursor->y - cursor->hotspot_y;
+        box.width = cursor->width;
+        box.height = cursor->height;
+        wlr_box_transform(&box, &box, wlr_output_transform_invert(_wlr_output->transform), width, height);
+        int x1 = std::max(box.x, 0) / TILE_SIZE, y1 = std::max(box.y, 0) / TILE_SIZE;
+        int x2 = std::min(box.x + box.width, output->width), y2 = std::min(box.y + box.height, output->height);
+        for (int ty = y1; ty * TILE_SIZE < y2; ty++) {
+            for (int tx = x1; tx * TILE_SIZE < x2; tx++) {
+                output->tile_read_back[ty * output->tiles_x + tx] = 1;
+                pixman_region32_union_rect(
+                    &tiles,
+                    &tiles,
+                    tx * TILE_SIZE,
+                    ty * TILE_SIZE,
+                    std::min(TILE_SIZE, output->width - tx * TILE_SIZE),
+                    std::min(TILE_SIZE, output->height - ty * TILE_SIZE)
+                );
+            }
+        }
+    }
+    if (!pixman_region32_not_empty(&tiles)) {
+        pixman_region32_fini(&tiles);
+        return;
+    }
+    if (!output->y_invert_known) {
+        pixman_region32_union_rect(&tiles, &tiles, 0, 0, output->width, output->height);
+    }
+    pixman_region32_union(damage, damage, &tiles);
+    if (!output_read_back(output, &tiles)) {
+        output->tile_read_back.assign(tile_count(output), 0);
+    }
+    pixman_region32_fini(&tiles);
+}
+
+static void output_handle_precommit(wl_listener *listener, void *data) {
+    RfbOutput *output = wl_container_of(listener, output, precommit);
+    wlr_output *_wlr_output = output->output->output;
+    if (wl_list_empty(&output->clients) ||
+        !(_wlr_output->pending.committed & WLR_OUTPUT_STATE_BUFFER) ||
+        _wlr_output->pending.buffer_type != WLR_OUTPUT_STATE_BUFFER_RENDER) {
+        return;
+    }
+    TRACE_SCOPE("rfb_capture");
+    if (_wlr_output->width != output->width || _wlr_output->height != output->height) {
+        output_resize(output, _wlr_output->width, _wlr_output->height);
+    }
+
+    pixman_region32_t damage;
+    pixman_region32_init(&damage);
+    if (_wlr_output->pending.committed & WLR_OUTPUT_STATE_DAMAGE) {
+        pixman_region32_intersect_rect(
+            &damage,
+            &_wlr_output->pending.damage,
+            0,
+            0,
+            output->width,
+            output->height
+        );
+    } else {
+        pixman_region32_union_rect(&damage, &damage, 0, 0, output->width, output->height);
+    }
+
+    // The software compositor's frame is the output's frame, short of the
+    // software cursor, and can be served as it is but for the cursor's
+    // tiles.
+    Server *server = output->rfb->server;
+    const SoftwareFrame *software = &output->output->software;
+    bool zero_copy = server->software_render && software->valid &&
+        software->width == output->width && software->height == output->height;
+    if (zero_copy != output->zero_copy || (!zero_copy && !output->readback_valid)) {
+        pixman_region32_union_rect(&damage, &damage, 0, 0, output->width, output->height);
+    }
+    output->zero_copy = zero_copy;
+    if (zero_copy) {
+        output->frame = software->pixels.data();
+        output->readback_valid = false;
+        output_read_back_cursors(output, &damage);
+    } else if (output_read_back(output, &damage)) {
+        output->frame = output->readback.data();
+        output->readback_valid = true;
+    } else {
+        output->frame = NULL;
+        output->readback_valid = false;
+        pixman_region32_fini(&damage);
+        return;
+    }
+
+    int nrects;
+    pixman_box32_t *rects = pixman_region32_rectangles(&damage, &nrects);
+    for (int i = 0; i < nrects; i++) {
+        for (int ty = rects[i].y1 / TILE_SIZE; ty <= (rects[i].y2 - 1) / TILE_SIZE; ty++) {
+            for (int tx = rects[i].x1 / TILE_SIZE; tx <= (rects[i].x2 - 1) / TILE_SIZE; tx++) {
+                int tile = ty * output->tiles_x + tx;
+                output->tile_hash_valid[tile] = 0;
+                RfbClient *client;
+                wl_list_for_each(client, &output->clients, link) {
+                    client->dirty[tile] = 1;
+                }
+            }
+        }
+    }
+    pixman_region32_fini(&damage);
+}
+
+static void output_handle_repaint(wl_listener *listener, void *data) {
+    RfbOutput *output = wl_container_of(listener, output, repaint);
+    RfbClient *client, *tmp;
+    wl_list_for_each_safe(client, tmp, &output->clients, link) {
+        if (client->state == RFB_CLIENT_NORMAL && !client_send_update(client)) {
+            client_destroy(client);
+        }
+    }
+}
+
+static void output_handle_destroy(wl_listener *listener, void *data) {
+    RfbOutput *output = wl_container_of(listener, output, destroy);
+    RfbClient *client, *tmp;
+    wl_list_for_each_safe(client, tmp, &output->clients, link) {
+        client_destroy(client);
+    }
+    wl_event_source_remove(output->listen_source);
+    close(output->listen_fd);
+    wl_list_remove(&output->precommit.link);
+    wl_list_remove(&output->repaint.link);
+    wl_list_remove(&output->destroy.link);
+    wl_list_remove(&output->link);
+    delete output;
+}
+
+static int listen_on(const RfbConfig *config) {
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(config->port);
+    if (inet_pton(AF_INET, config->address.c_str(), &addr.sin_addr) != 1) {
+        return -1;
+    }
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0 || listen(fd, 8) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+void rfb_add_output(Rfb *rfb, Output *output) {
+    const RfbConfig *config = NULL;
+    for (const RfbConfig &candidate : rfb->configs) {
+        if (candidate.output_name == output->output->name) {
+            config = &candidate;
+            break;
+        }
+    }
+    if (config == NULL) {
+        return;
+    }
+    int fd = listen_on(config);
+    if (fd < 0) {
+        wlr_log(WLR_ERROR, "RFB: can't listen on %s:%d for output %s: %s",
+                config->address.c_str(), config->port, output->output->name, strerror(errno));
+        return;
+    }
+
+    RfbOutput *rfb_output = new RfbOutput;
+    rfb_output->rfb = rfb;
+    rfb_output->output = output;
+    rfb_output->listen_fd = fd;
+    rfb_output->listen_source = wl_event_loop_add_fd(
+        wl_display_get_event_loop(rfb->server->display),
+        fd,
+        WL_EVENT_READABLE,
+        output_handle_accept,
+        rfb_output
+    );
+    wl_list_init(&rfb_output->clients);
+    rfb_output->zero_copy = false;
+    rfb_output->y_invert = false;
+    output_resize(rfb_output, output->output->width, output->output->height);
+
+    rfb_output->precommit.notify = output_handle_precommit;
+    wl_signal_add(&output->output->events.precommit, &rfb_output->precommit);
+    rfb_output->repaint.notify = output_handle_repaint;
+    wl_signal_add(&output->events.repaint, &rfb_output->repaint);
+    rfb_output->destroy.notify = output_handle_destroy;
+    wl_signal_add(&output->events.destroy, &rfb_output->destroy);
+    wl_list_insert(&rfb->outputs, &rfb_output->link);
+    wlr_log(WLR_INFO, "RFB: serving output %s on %s:%d",
+            output->output->name, config->address.c_str(), config->port);
+}
+
+bool rfb_parse_config(const char *spec, RfbConfig *config) {
+    const char *equals = strchr(spec, '=');
+    if (equals == NULL || equals == spec) {
+        return false;
+    }
+    config->output_name.assign(spec, equals - spec);
+    std::string rest = equals + 1;
+    size_t colon = rest.rfind(':');
+    config->address = colon == std::string::npos ? "127.0.0.1" : rest.substr(0, colon);
+    std::string port = colon == std::string::npos ? rest : rest.substr(colon + 1);
+    char *end;
+    long value = strtol(port.c_str(), &end, 10);
+    if (port.empty() || *end != '\0' || value <= 0 || value > 65535) {
+        return false;
+    }
+    config->port = value;
+    return true;
+}
+
+Rfb *rfb_create(Server *server, const std::vector<RfbConfig> &configs) {
+    wlr_backend *backend = server->backend;
+    if (wlr_backend_is_multi(backend)) {
+        wlr_backend *headless = wlr_headless_backend_create_with_renderer(
+            server->display,
+            server->renderer
+        );
+        if (headless == NULL || !wlr_multi_backend_add(backend, headless)) {
+            wlr_log(WLR_ERROR, "RFB: failed to add a backend for remote input");
+            return NULL;
+        }
+        backend = headless;
+    } else if (!wlr_backend_is_headless(backend)) {
+        wlr_log(WLR_ERROR, "RFB: no way to add remote input devices to this backend");
+        return NULL;
+    }
+
+    Rfb *rfb = new Rfb;
+    rfb->server = server;
+    rfb->configs = configs;
+    wl_list_init(&rfb->outputs);
+    rfb->pointer = wlr_headless_add_input_device(backend, WLR_INPUT_DEVICE_POINTER);
+    rfb->keyboard = wlr_headless_add_input_device(backend, WLR_INPUT_DEVICE_KEYBOARD);
+    rfb->keycodes_keymap = NULL;
+    return rfb;
+}
+
+void rfb_destroy(Rfb *rfb) {
+    // Outputs and devices are gone with the backend by now.
+    delete rfb;
+}
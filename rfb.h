@@ -0,0 +1,55 @@
+// Copyright © 2020 Mateus Carmo Martins de Freitas Barbosa
+//
+// This program is licensed under the GNU General Public License, version 3.
+// See LICENSE.txt.
+//
+
+#ifndef STACKTILE_RFB_H
+#define STACKTILE_RFB_H
+
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <wayland-server-core.h>
+struct wlr_input_device;
+struct xkb_keymap;
+struct Output;
+struct Server;
+
+// An RFB (VNC) server for chosen outputs, meant for headless ones. Every
+// output listens on its own port and sends viewers the tiles that were
+// damaged and actually changed since they last got them. There's no
+// authentication, so it listens on localhost unless told otherwise.
+struct RfbConfig {
+    std::string output_name;
+    std::string address;
+    int port;
+};
+
+// Parses NAME=[ADDRESS:]PORT.
+bool rfb_parse_config(const char *spec, RfbConfig *config);
+
+struct Rfb {
+    Server *server;
+    std::vector<RfbConfig> configs;
+    // RfbOutput::link
+    wl_list outputs;
+    // Remote input goes through virtual devices on a headless backend, so
+    // that it takes the same paths as local input.
+    wlr_input_device *pointer;
+    wlr_input_device *keyboard;
+    // Keysyms, which is what viewers send, to keycodes of the virtual
+    // keyboard's keymap. Rebuilt whenever the keymap changes.
+    xkb_keymap *keycodes_keymap;
+    std::unordered_map<uint32_t, uint32_t> keycodes;
+};
+
+// Must be called before the backend starts. Returns NULL when there's no
+// way to add virtual input devices to the backend.
+Rfb *rfb_create(Server *server, const std::vector<RfbConfig> &configs);
+void rfb_destroy(Rfb *rfb);
+// Starts serving the output if it was asked for.
+void rfb_add_output(Rfb *rfb, Output *output);
+
+#endif /* STACKTILE_RFB_H */
@@ -0,0 +1,338 @@
+// Copyright © 2020 Mateus Carmo Martins de Freitas Barbosa
+//
+// This program is licensed under the GNU General Public License, version 3.
+// See LICENSE.txt.
+//
+
+#include <arpa/inet.h>
+#include <getopt.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+
+#include "histogram.h"
+
+// Connects to stacktile's RFB server like a viewer would, and measures what
+// it gets: bytes and rectangles per update and, when it moves the pointer
+// itself, the time from the pointer event to the update showing it.
+
+struct Probe {
+    int fd;
+    int width, height;
+    int bytes_per_pixel;
+};
+
+static int64_t now_usec() {
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000LL + now.tv_nsec / 1000;
+}
+
+// Waits at most timeout_msec for the first byte, then reads the rest.
+// Returns false on timeout or when the connection is gone.
+static bool read_exactly(Probe *probe, void *data, size_t size, int timeout_msec) {
+    auto p = static_cast<uint8_t*>(data);
+    while (size > 0) {
+        pollfd pfd = { probe->fd, POLLIN, 0 };
+        if (poll(&pfd, 1, timeout_msec) <= 0) {
+            return false;
+        }
+        ssize_t n = read(probe->fd, p, size);
+        if (n <= 0) {
+            return false;
+        }
+        p += n;
+        size -= n;
+        timeout_msec = 5000;
+    }
+    return true;
+}
+
+static bool write_all(Probe *probe, const void *data, size_t size) {
+    auto p = static_cast<const uint8_t*>(data);
+    while (size > 0) {
+        ssize_t n = write(probe->fd, p, size);
+        if (n <= 0) {
+            return false;
+        }
+        p += n;
+        size -= n;
+    }
+    return true;
+}
+
+static uint16_t get_u16(const uint8_t *p) {
+    return p[0] << 8 | p[1];
+}
+
+static uint32_t get_u32(const uint8_t *p) {
+    return static_cast<uint32_t>(p[0]) << 24 | p[1] << 16 | p[2] << 8 | p[3];
+}
+
+static void put_u16(uint8_t *p, uint16_t value) {
+    p[0] = value >> 8;
+    p[1] = value;
+}
+
+static void put_u32(uint8_t *p, uint32_t value) {
+    put_u16(p, value >> 16);
+    put_u16(p + 2, value);
+}
+
+static bool handshake(Probe *probe) {
+    char version[12];
+    if (!read_exactly(probe, version, sizeof(version), 5000) ||
+        memcmp(version, "RFB 003.", 8) != 0) {
+        fprintf(stderr, "not an RFB server\n");
+        return false;
+    }
+    if (!write_all(probe, "RFB 003.008\n", 12)) {
+        return false;
+    }
+    uint8_t count;
+    if (!read_exactly(probe, &count, 1, 5000) || count == 0) {
+        return false;
+    }
+    std::vector<uint8_t> types(count);
+    if (!read_exactly(probe, types.data(), count, 5000)) {
+        return false;
+    }
+    uint8_t none = 1;
+    uint8_t result[4];
+    if (!write_all(probe, &none, 1) || !read_exactly(probe, result, 4, 5000) ||
+        get_u32(result) != 0) {
+        fprintf(stderr, "the server wants authentication\n");
+        return false;
+    }
+
+    uint8_t shared = 1;
+    uint8_t init[24];
+    if (!write_all(probe, &shared, 1) || !read_exactly(probe, init, sizeof(init), 5000)) {
+        return false;
+    }
+    probe->width = get_u16(init);
+    probe->height = get_u16(init + 2);
+    probe->bytes_per_pixel = init[4] / 8;
+    std::string name(get_u32(init + 20), '\0');
+    if (!read_exactly(probe, &name[0], name.size(), 5000)) {
+        return false;
+    }
+    printf("connected to \"%s\", %dx%d at %d bpp\n",
+           name.c_str(), probe->width, probe->height, probe->bytes_per_pixel * 8);
+
+    // Raw and DesktopSize.
+    uint8_t encodings[12] = { 2, 0 };
+    put_u16(encodings + 2, 2);
+    put_u32(encodings + 4, 0);
+    put_u32(encodings + 8, static_cast<uint32_t>(-223));
+    return write_all(probe, encodings, sizeof(encodings));
+}
+
+static bool request_update(Probe *probe, bool incremental) {
+    uint8_t request[10] = { 3, incremental };
+    put_u16(request + 2, 0);
+    put_u16(request + 4, 0);
+    put_u16(request + 6, probe->width);
+    put_u16(request + 8, probe->height);
+    return write_all(probe, request, sizeof(request));
+}
+
+static bool move_pointer(Probe *probe, int x, int y) {
+    uint8_t event[6] = { 5, 0 };
+    put_u16(event + 2, x);
+    put_u16(event + 4, y);
+    return write_all(probe, event, sizeof(event));
+}
+
+// Reads server messages until a framebuffer update, returning its size in
+// bytes and rectangles, or false after timeout_msec without one.
+static bool read_update(Probe *probe, int timeout_msec, size_t *bytes, int *rects) {
+    std::vector<uint8_t> skip;
+    for (;;) {
+        uint8_t type;
+        if (!read_exactly(probe, &type, 1, timeout_msec)) {
+            return false;
+        }
+        if (type == 2) {
+            // Bell.
+            continue;
+        }
+        if (type == 3) {
+            uint8_t header[7];
+            if (!read_exactly(probe, header, sizeof(header), 5000)) {
+                return false;
+            }
+            skip.resize(get_u32(header + 3));
+            if (!read_exactly(probe, skip.data(), skip.size(), 5000)) {
+                return false;
+            }
+            continue;
+        }
+        if (type != 0) {
+            fprintf(stderr, "unexpected message type %d\n", type);
+            return false;
+        }
+
+        uint8_t header[3];
+        if (!read_exactly(probe, header, sizeof(header), 5000)) {
+            return false;
+        }
+        *rects = get_u16(header + 1);
+        *bytes = 4;
+        for (int i = 0; i < *rects; i++) {
+            uint8_t rect[12];
+            if (!read_exactly(probe, rect, sizeof(rect), 5000)) {
+                return false;
+            }
+            int width = get_u16(rect + 4), height = get_u16(rect + 6);
+            int32_t encoding = get_u32(rect + 8);
+            *bytes += sizeof(rect);
+            if (encoding == -223) {
+                probe->width = width;
+                probe->height = height;
+                continue;
+            }
+            if (encoding != 0) {
+                fprintf(stderr, "unexpected encoding %d\n", encoding);
+                return false;
+            }
+            skip.resize(static_cast<size_t>(width) * height * probe->bytes_per_pixel);
+            if (!read_exactly(probe, skip.data(), skip.size(), 5000)) {
+                return false;
+            }
+            *bytes += skip.size();
+        }
+        return true;
+    }
+}
+
+static void usage(const char *name) {
+    printf("Usage: %s [-a address] [-p port] [-n updates] [-w timeout msec] [-i]\n"
+           "  -i moves the pointer before every request, to measure latency\n", name);
+}
+
+int main(int argc, char *argv[]) {
+    const char *address = "127.0.0.1";
+    int port = 5900;
+    int updates = 300;
+    int timeout = 1000;
+    bool input = false;
+
+    int c;
+    while ((c = getopt(argc, argv, "a:p:n:w:ih")) != -1) {
+        switch (c) {
+        case 'a':
+            address = optarg;
+            break;
+        case 'p':
+            port = atoi(optarg);
+            break;
+        case 'n':
+            updates = atoi(optarg);
+            break;
+        case 'w':
+            timeout = atoi(optarg);
+            break;
+        case 'i':
+            input = true;
+            break;
+        default:
+            usage(argv[0]);
+            return 0;
+        }
+    }
+    if (optind < argc || updates < 1 || timeout < 1) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    Probe probe;
+    probe.fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (inet_pton(AF_INET, address, &addr.sin_addr) != 1 || probe.fd < 0 ||
+        connect(probe.fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+        fprintf(stderr, "failed to connect to %s:%d\n", address, port);
+        return 1;
+    }
+    int one = 1;
+    setsockopt(probe.fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    if (!handshake(&probe)) {
+        return 1;
+    }
+
+    size_t bytes;
+    int rects;
+    int64_t start = now_usec();
+    if (!request_update(&probe, false) || !read_update(&probe, 5000, &bytes, &rects)) {
+        fprintf(stderr, "no initial frame\n");
+        return 1;
+    }
+    printf("initial frame:   %zu bytes, %d rects, %.1f ms\n",
+           bytes, rects, (now_usec() - start) / 1000.0);
+
+    Histogram latency_usec, update_bytes, update_rects;
+    histogram_init(&latency_usec);
+    histogram_init(&update_bytes);
+    histogram_init(&update_rects);
+    uint64_t total_bytes = 0;
+    int received = 0, timeouts = 0;
+    start = now_usec();
+    for (int i = 0; i < updates; i++) {
+        int64_t sent = now_usec();
+        if (input) {
+            // Back and forth across the middle of the output.
+            int x = probe.width / 2 + (i % 2 ? 40 : -40);
+            if (!move_pointer(&probe, x, probe.height / 2)) {
+                break;
+            }
+        }
+        if (!request_update(&probe, true)) {
+            break;
+        }
+        if (!read_update(&probe, timeout, &bytes, &rects)) {
+            // Nothing changed, and the request may still be answered
+            // later, so the rest of the run isn't to be trusted.
+            timeouts++;
+            break;
+        }
+        received++;
+        total_bytes += bytes;
+        histogram_add(&latency_usec, now_usec() - sent);
+        histogram_add(&update_bytes, bytes);
+        histogram_add(&update_rects, rects);
+    }
+    double elapsed = (now_usec() - start) / 1e6;
+
+    printf("updates:         %d in %.2f s%s\n", received, elapsed,
+           timeouts > 0 ? ", stopped waiting for one" : "");
+    if (received == 0) {
+        return 0;
+    }
+    printf("bytes/update:    mean %.0f, p50 %d, p99 %d, max %d\n",
+           static_cast<double>(total_bytes) / received,
+           histogram_percentile(&update_bytes, 50),
+           histogram_percentile(&update_bytes, 99),
+           histogram_max(&update_bytes));
+    printf("rects/update:    p50 %d, max %d\n",
+           histogram_percentile(&update_rects, 50),
+           histogram_max(&update_rects));
+    printf("throughput:      %.1f KiB/s\n", total_bytes / 1024.0 / elapsed);
+    printf("%s p50 %.2f ms, p99 %.2f ms, max %.2f ms\n",
+           input ? "input-to-update:" : "update wait:    ",
+           histogram_percentile(&latency_usec, 50) / 1000.0,
+           histogram_percentile(&latency_usec, 99) / 1000.0,
+           histogram_max(&latency_usec) / 1000.0);
+    close(probe.fd);
+    return 0;
+}
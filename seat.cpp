@@ -33,6 +33,7 @@ void seat_handle_request_cursor(wl_listener *listener, void *data) {
             event->hotspot_x,
             event->hotspot_y
         );
+        server->cursor_image = NULL;
     }
 }
 
@@ -4,20 +4,21 @@
 // See LICENSE.txt.
 //
 
-#include <getopt.h>
 #include <stdlib.h>
-#include <stdio.h>
-#include <time.h>
-#include <unistd.h>
 #include <wayland-server-core.h>
 
 extern "C" {
 #define static
 
 #include <wlr/backend.h>
+#include <wlr/backend/headless.h>
 #include <wlr/types/wlr_compositor.h>
 #include <wlr/types/wlr_data_device.h>
+#include <wlr/types/wlr_export_dmabuf_v1.h>
+#include <wlr/types/wlr_presentation_time.h>
+#include <wlr/types/wlr_screencopy_v1.h>
 #include <wlr/types/wlr_xcursor_manager.h>
+#include <wlr/types/wlr_xdg_output_v1.h>
 #include <wlr/types/wlr_xdg_shell.h>
 #include <wlr/util/log.h>
 
@@ -25,33 +26,89 @@ extern "C" {
 }
 
 #include "cursor.h"
+#include "idle.h"
 #include "keyboard.h"
+#include "rfb.h"
 #include "seat.h"
 #include "server.h"
+#include "stats.h"
+#include "surface.h"
 #include "output.h"
 #include "view.h"
 
-static bool server_init(Server *server) {
+void server_config_init(ServerConfig *config) {
+    config->hidden_frame_rate = 1;
+    config->software_threads = -1;
+    config->headless = false;
+    config->idle_timeout = 0;
+    config->tiling = true;
+}
+
+bool server_init(Server *server, const ServerConfig *config) {
     if (server == NULL) {
         return false;
     }
 
+    server->hidden_frame_rate = config->hidden_frame_rate;
     server->display = wl_display_create();
-    server->backend = wlr_backend_autocreate(server->display, NULL);
+    if (config->headless) {
+        server->backend = wlr_headless_backend_create(server->display, NULL);
+    } else {
+        server->backend = wlr_backend_autocreate(server->display, NULL);
+    }
+    if (server->backend == NULL) {
+        wl_display_destroy(server->display);
+        return false;
+    }
 
     server->renderer = wlr_backend_get_renderer(server->backend);
     wlr_renderer_init_wl_display(server->renderer, server->display);
 
-    wlr_compositor_create(server->display, server->renderer);
+    server->compositor = wlr_compositor_create(server->display, server->renderer);
+    server->new_surface.notify = handle_new_surface;
+    wl_signal_add(&server->compositor->events.new_surface, &server->new_surface);
+    server->hidden_frame_timer = wl_event_loop_add_timer(
+        wl_display_get_event_loop(server->display),
+        surfaces_send_hidden_frame_done,
+        server
+    );
+    server->hidden_frame_timer_armed = false;
+    server->surface_commits = 0;
+    server->software_render = config->software_threads >= 0;
+    thread_pool_init(&server->render_pool, server->software_render ? config->software_threads : 1);
+    if (server->software_render) {
+        wlr_log(WLR_INFO, "Compositing on the CPU with %d threads",
+                thread_pool_size(&server->render_pool));
+    }
+
     wlr_data_device_manager_create(server->display);
 
     server->output_layout = wlr_output_layout_create();
+    server->output_layout_change.notify = handle_output_layout_change;
+    wl_signal_add(&server->output_layout->events.change, &server->output_layout_change);
 
     wl_list_init(&server->outputs);
+    server->output_masks = 0;
+    server->adaptive_sync_outputs = config->adaptive_sync_outputs;
     server->new_output.notify = handle_new_output;
     wl_signal_add(&server->backend->events.new_output, &server->new_output);
 
+    // Capture clients lock the outputs into rendering while a frame is
+    // pending, and only then is anything read back. Copies with damage
+    // wait for a commit carrying some, see wlr_output_set_damage in
+    // output_render. xdg-output tells them where outputs are.
+    wlr_screencopy_manager_v1_create(server->display);
+    wlr_export_dmabuf_manager_v1_create(server->display);
+    wlr_xdg_output_manager_v1_create(server->display, server->output_layout);
+    server->presentation = wlr_presentation_create(server->display, server->backend);
+    idle_init(server, config->idle_timeout);
+
     wl_list_init(&server->views);
+    server->tiling = config->tiling;
+    stacking_init(&server->stacking);
+    render_list_init(&server->render_list);
+    server->pending_transaction = NULL;
+    server->inflight_transaction = NULL;
     server->xdg_shell = wlr_xdg_shell_create(server->display);
     server->new_xdg_surface.notify = handle_new_xdg_surface;
     wl_signal_add(&server->xdg_shell->events.new_surface, &server->new_xdg_surface);
@@ -74,10 +131,15 @@ static bool server_init(Server *server) {
     server->cursor_axis.notify = handle_cursor_axis;
     wl_signal_add(&server->cursor->events.axis, &server->cursor_axis);
 
+    server->motion_pending = false;
+    server->cursor_image = NULL;
+
     server->cursor_frame.notify = handle_cursor_frame;
     wl_signal_add(&server->cursor->events.frame, &server->cursor_frame);
 
     wl_list_init(&server->keyboards);
+    wl_list_init(&server->keyboard_groups);
+    keymap_cache_init(&server->keymaps);
     server->new_input.notify = handle_new_input;
     wl_signal_add(&server->backend->events.new_input, &server->new_input);
 
@@ -89,6 +151,17 @@ static bool server_init(Server *server) {
     server->request_set_selection.notify = seat_handle_request_set_selection;
     wl_signal_add(&server->seat->events.request_set_selection, &server->request_set_selection);
 
+    // The RFB server's virtual input devices must exist before the backend
+    // starts.
+    server->rfb = NULL;
+    if (!config->rfb.empty()) {
+        server->rfb = rfb_create(server, config->rfb);
+        if (server->rfb == NULL) {
+            wlr_backend_destroy(server->backend);
+            return false;
+        }
+    }
+
     const char *socket = wl_display_add_socket_auto(server->display);
     if (!socket) {
         wlr_backend_destroy(server->backend);
@@ -104,46 +177,19 @@ static bool server_init(Server *server) {
     setenv("WAYLAND_DISPLAY", socket, true);
     wlr_log(WLR_INFO, "Initialized Wayland compositor on WAYLAND_DISPLAY=%s", socket);
 
+    stats_init(server);
+
     return true;
 }
 
-int main(int argc, char *argv[]) {
-    wlr_log_init(WLR_DEBUG, NULL);
-    char *startup_cmd = NULL;
-
-    int c;
-    while ((c = getopt(argc, argv, "s:h")) != -1) {
-        switch (c) {
-        case 's':
-            startup_cmd = optarg;
-            break;
-        default:
-            printf("Usage: %s [-s startup command]\n", argv[0]);
-            return 0;
-        }
-    }
-    if (optind < argc) {
-        printf("Usage: %s [-s startup command]\n", argv[0]);
-        return 0;
-    }
-
-    Server server;
-    if (!server_init(&server)) {
-        return 1;
+void server_finish(Server *server) {
+    stats_finish(server);
+    idle_finish(server);
+    wl_display_destroy_clients(server->display);
+    wl_display_destroy(server->display);
+    if (server->rfb != NULL) {
+        rfb_destroy(server->rfb);
     }
-    if (startup_cmd) {
-        pid_t child = fork();
-        if (child == 0) {
-            execl("/bin/sh", "/bin/sh", "-c", startup_cmd, (void *)NULL);
-        } else if (child < 0) {
-            wlr_log(WLR_ERROR, "failed to fork child process!");
-            wl_display_destroy(server.display);
-            return 1;
-        }
-    }
-    wl_display_run(server.display);
-
-    wl_display_destroy_clients(server.display);
-    wl_display_destroy(server.display);
-    return 0;
+    keymap_cache_finish(&server->keymaps);
+    thread_pool_finish(&server->render_pool);
 }
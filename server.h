@@ -7,25 +7,76 @@
 #ifndef STACKTILE_SERVER_H
 #define STACKTILE_SERVER_H
 
+#include <string>
+#include <vector>
 #include <wayland-server-core.h>
 #include "cursor.h"
+#include "grid.h"
+#include "keymap.h"
+#include "renderlist.h"
+#include "rfb.h"
+#include "stacking.h"
+#include "stats.h"
+#include "threadpool.h"
 struct wlr_backend;
+struct wlr_compositor;
 struct wlr_renderer;
 struct wlr_xdg_shell;
 struct wlr_cursor;
 struct wlr_xcursor_manager;
 struct wlr_seat;
 struct wlr_output_layout;
+struct wlr_presentation;
+struct wlr_idle_inhibit_manager_v1;
+struct Transaction;
 struct View;
 
+struct ServerConfig {
+    // Frame callbacks per second for surfaces not visible on any output,
+    // 0 holds them until the surface becomes visible.
+    int hidden_frame_rate;
+    // Threads compositing outputs on the CPU, see swrender.h. 0 means one
+    // per core, and a negative number leaves composition to the renderer.
+    int software_threads;
+    // The headless backend starts out with no outputs or input devices,
+    // the caller adds them with wlr_headless_add_output and
+    // wlr_headless_add_input_device.
+    bool headless;
+    // Outputs served over RFB.
+    std::vector<RfbConfig> rfb;
+    // Names of outputs with variable refresh on all the time, instead of
+    // only for fullscreen views.
+    std::vector<std::string> adaptive_sync_outputs;
+    // Seconds without input before outputs are powered off, 0 for never.
+    int idle_timeout;
+    // Whether new views are tiled, see arrange.h, or float.
+    bool tiling;
+};
+
 struct Server {
     wl_display *display;
     wlr_backend *backend;
     wlr_renderer *renderer;
 
+    wlr_compositor *compositor;
+    wl_listener new_surface;
+    int hidden_frame_rate;
+    wl_event_source *hidden_frame_timer;
+    bool hidden_frame_timer_armed;
+    uint64_t surface_commits;
+    // Whether outputs are composited on the CPU, see swrender.h.
+    bool software_render;
+    ThreadPool render_pool;
+
     wlr_xdg_shell *xdg_shell;
     wl_listener new_xdg_surface;
     wl_list views;
+    bool tiling;
+    Grid view_grid;
+    RenderList render_list;
+    Stacking stacking;
+    Transaction *pending_transaction;
+    Transaction *inflight_transaction;
 
     wlr_cursor *cursor;
     wlr_xcursor_manager *cursor_mgr;
@@ -34,12 +85,21 @@ struct Server {
     wl_listener cursor_button;
     wl_listener cursor_axis;
     wl_listener cursor_frame;
+    bool motion_pending;
+    uint32_t motion_time;
+    // Of the first motion event since the last flush, for the latency
+    // stats.
+    uint32_t motion_first_time;
+    // The xcursor image last set by us, NULL when a client set its own.
+    const char *cursor_image;
 
     wlr_seat *seat;
     wl_listener new_input;
     wl_listener request_cursor;
     wl_listener request_set_selection;
     wl_list keyboards;
+    wl_list keyboard_groups;
+    KeymapCache keymaps;
     CursorMode cursor_mode;
     View *grabbed_view;
     double grab_x, grab_y;
@@ -47,8 +107,34 @@ struct Server {
     uint32_t resize_edges;
 
     wlr_output_layout *output_layout;
+    wl_listener output_layout_change;
     wl_list outputs;
+    uint32_t output_masks;
     wl_listener new_output;
+    std::vector<std::string> adaptive_sync_outputs;
+    wlr_presentation *presentation;
+
+    wlr_idle_inhibit_manager_v1 *idle_inhibit;
+    wl_event_source *idle_timer;
+    int idle_timeout_msec;
+    int64_t last_activity_msec;
+    bool outputs_asleep;
+
+    // NULL unless some output is served over RFB.
+    Rfb *rfb;
+
+    wl_event_source *stats_signal;
+    // SIGINT and SIGTERM stop the display like Logo+Escape does, so that
+    // everything gets finished, the trace included.
+    wl_event_source *terminate_signals[2];
+    wl_event_source *stats_socket;
+    int stats_fd;
+    std::string stats_path;
+    SeatStats seat_stats;
 };
 
+void server_config_init(ServerConfig *config);
+bool server_init(Server *server, const ServerConfig *config);
+void server_finish(Server *server);
+
 #endif /* STACKTILE_SERVER_H */
@@ -0,0 +1,23 @@
+// Copyright © 2020 Mateus Carmo Martins de Freitas Barbosa
+//
+// This program is licensed under the GNU General Public License, version 3.
+// See LICENSE.txt.
+//
+
+#include "stacking.h"
+
+void stacking_init(Stacking *stacking) {
+    stacking->top = stacking->bottom = 0;
+}
+
+int64_t stacking_raise(Stacking *stacking) {
+    return ++stacking->top;
+}
+
+int64_t stacking_lower(Stacking *stacking) {
+    return --stacking->bottom;
+}
+
+bool stacking_is_top(const Stacking *stacking, int64_t z) {
+    return z == stacking->top;
+}
@@ -0,0 +1,24 @@
+// Copyright © 2020 Mateus Carmo Martins de Freitas Barbosa
+//
+// This program is licensed under the GNU General Public License, version 3.
+// See LICENSE.txt.
+//
+
+#ifndef STACKTILE_STACKING_H
+#define STACKTILE_STACKING_H
+
+#include <stdint.h>
+
+// Hands out stacking positions, higher is closer to the top. Raising or
+// lowering something is O(1): it just takes a position past the current
+// top or bottom, nothing else is renumbered.
+struct Stacking {
+    int64_t top, bottom;
+};
+
+void stacking_init(Stacking *stacking);
+int64_t stacking_raise(Stacking *stacking);
+int64_t stacking_lower(Stacking *stacking);
+bool stacking_is_top(const Stacking *stacking, int64_t z);
+
+#endif /* STACKTILE_STACKING_H */
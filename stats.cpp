@@ -0,0 +1,300 @@
+// Copyright © 2020 Mateus Carmo Martins de Freitas Barbosa
+//
+// This program is licensed under the GNU General Public License, version 3.
+// See LICENSE.txt.
+//
+
+#include <errno.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <wayland-server-core.h>
+
+extern "C" {
+#define static
+
+#include <wlr/types/wlr_box.h>
+#include <wlr/types/wlr_output.h>
+#include <wlr/types/wlr_seat.h>
+#include <wlr/types/wlr_surface.h>
+#include <wlr/util/log.h>
+
+#undef static
+}
+
+#include "output.h"
+#include "server.h"
+#include "stats.h"
+#include "surface.h"
+
+// A client that takes longer than this didn't respond to the event, and
+// the surface waits on the next one instead.
+static const int64_t INPUT_RESPONSE_TIMEOUT_USEC = 1000000;
+
+void output_stats_init(OutputStats *stats) {
+    histogram_init(&stats->render_usec);
+    histogram_init(&stats->frame_to_commit_usec);
+    histogram_init(&stats->views_drawn);
+    histogram_init(&stats->surfaces_drawn);
+    stats->frames_composited = 0;
+    stats->frames_scanned_out = 0;
+    stats->frames_skipped = 0;
+    stats->frames_blocked = 0;
+    stats->commit_failures = 0;
+}
+
+static int64_t now_usec() {
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000LL + now.tv_nsec / 1000;
+}
+
+// Event timestamps are milliseconds that wrap around, so this compares the
+// low 32 bits only. Since an event happens somewhere within its
+// millisecond, this can be up to 1 ms too long.
+static int64_t input_age_usec(uint32_t time_msec, int64_t now_usec) {
+    auto age_msec = static_cast<int32_t>(static_cast<uint32_t>(now_usec / 1000) - time_msec);
+    return static_cast<int64_t>(age_msec) * 1000 + now_usec % 1000;
+}
+
+void stats_input_handled(Server *server, uint32_t time_msec, wlr_surface *target) {
+    SeatStats *stats = &server->seat_stats;
+    int64_t now = now_usec();
+    int64_t age = input_age_usec(time_msec, now);
+    if (age < 0 || age > INPUT_RESPONSE_TIMEOUT_USEC) {
+        stats->bad_timestamps++;
+        return;
+    }
+    histogram_add(&stats->input_to_handled_usec, age);
+
+    auto surface = target != NULL ? reinterpret_cast<Surface*>(target->data) : NULL;
+    if (surface == NULL) {
+        return;
+    }
+    // Events the client is still busy with are older, so the response
+    // is measured from the first of them.
+    if (surface->input_state == SURFACE_INPUT_IDLE ||
+        now - surface->input_usec > INPUT_RESPONSE_TIMEOUT_USEC) {
+        surface->input_state = SURFACE_INPUT_WAITING;
+        surface->input_usec = now - age;
+    }
+}
+
+void stats_surface_commit(Surface *surface) {
+    if (surface->input_state == SURFACE_INPUT_WAITING) {
+        surface->input_state = SURFACE_INPUT_COMMITTED;
+    }
+}
+
+void stats_output_commit(Output *output, int64_t now_nsec) {
+    SeatStats *stats = &output->server->seat_stats;
+    for (Surface *surface : output->visible) {
+        if (surface->input_state != SURFACE_INPUT_COMMITTED) {
+            continue;
+        }
+        // A surface that was hidden, or on an output that was off, may
+        // only be shown long after its response. That isn't latency.
+        int64_t age = now_nsec / 1000 - surface->input_usec;
+        if (age <= INPUT_RESPONSE_TIMEOUT_USEC) {
+            histogram_add(&stats->input_to_display_usec, std::max<int64_t>(age, 0));
+        }
+        surface->input_state = SURFACE_INPUT_IDLE;
+    }
+}
+
+static void appendf(std::string *out, const char *format, ...) {
+    char buffer[256];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+    out->append(buffer);
+}
+
+static void dump_histogram(std::string *out, const char *name, const Histogram *histogram) {
+    appendf(out, "  %-22s n=%zu p50=%d p90=%d p99=%d max=%d\n",
+            name,
+            histogram_size(histogram),
+            histogram_percentile(histogram, 50),
+            histogram_percentile(histogram, 90),
+            histogram_percentile(histogram, 99),
+            histogram_max(histogram));
+    for (int i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        if (histogram->buckets[i] == 0) {
+            continue;
+        }
+        if (i == HISTOGRAM_BUCKETS - 1) {
+            appendf(out, "    [%d, inf) %u\n", histogram_bucket_floor(i), histogram->buckets[i]);
+        } else {
+            appendf(out, "    [%d, %d) %u\n",
+                    histogram_bucket_floor(i),
+                    histogram_bucket_floor(i + 1),
+                    histogram->buckets[i]);
+        }
+    }
+}
+
+std::string stats_dump(Server *server) {
+    std::string out;
+    Output *output;
+    wl_list_for_each_reverse(output, &server->outputs, link) {
+        const OutputStats *stats = &output->stats;
+        appendf(&out, "output %s\n", output->output->name);
+        appendf(&out, "  composited %llu, scanned out %llu, skipped %llu, blocked %llu\n",
+                (unsigned long long)stats->frames_composited,
+                (unsigned long long)stats->frames_scanned_out,
+                (unsigned long long)stats->frames_skipped,
+                (unsigned long long)stats->frames_blocked);
+        appendf(&out, "  commit failures %llu, missed vblanks %d, max render time %d ms\n",
+                (unsigned long long)stats->commit_failures,
+                output->frames_missed,
+                output->max_render_time);
+        dump_histogram(&out, "render_usec", &stats->render_usec);
+        dump_histogram(&out, "frame_to_commit_usec", &stats->frame_to_commit_usec);
+        dump_histogram(&out, "views_drawn", &stats->views_drawn);
+        dump_histogram(&out, "surfaces_drawn", &stats->surfaces_drawn);
+    }
+
+    const SeatStats *seat_stats = &server->seat_stats;
+    appendf(&out, "seat %s\n", server->seat->name);
+    appendf(&out, "  bad input timestamps %llu\n",
+            (unsigned long long)seat_stats->bad_timestamps);
+    dump_histogram(&out, "input_to_handled_usec", &seat_stats->input_to_handled_usec);
+    dump_histogram(&out, "input_to_display_usec", &seat_stats->input_to_display_usec);
+    return out;
+}
+
+static int stats_handle_signal(int signal_number, void *data) {
+    auto server = reinterpret_cast<Server*>(data);
+    std::string dump = stats_dump(server);
+    fputs(dump.c_str(), stderr);
+    return 0;
+}
+
+static int stats_handle_terminate(int signal_number, void *data) {
+    auto server = reinterpret_cast<Server*>(data);
+    wlr_log(WLR_INFO, "Terminating on signal %d", signal_number);
+    wl_display_terminate(server->display);
+    return 0;
+}
+
+// Every connection gets a single dump, then it's closed. The socket never
+// blocks the event loop: whatever doesn't fit in its buffer is dropped, and
+// a client that went away fails with EPIPE instead of raising SIGPIPE.
+static int stats_handle_connection(int fd, uint32_t mask, void *data) {
+    auto server = reinterpret_cast<Server*>(data);
+    int client = accept4(fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (client < 0) {
+        return 0;
+    }
+    std::string dump = stats_dump(server);
+    size_t written = 0;
+    while (written < dump.size()) {
+        ssize_t n = send(client, dump.data() + written, dump.size() - written, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        written += n;
+    }
+    close(client);
+    return 0;
+}
+
+static bool stats_open_socket(Server *server) {
+    const char *runtime_dir = getenv("XDG_RUNTIME_DIR");
+    const char *display = getenv("WAYLAND_DISPLAY");
+    if (runtime_dir == NULL || display == NULL) {
+        return false;
+    }
+
+    sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    int len = snprintf(addr.sun_path, sizeof(addr.sun_path),
+                       "%s/stacktile-%s.stats", runtime_dir, display);
+    if (len < 0 || len >= static_cast<int>(sizeof(addr.sun_path))) {
+        return false;
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return false;
+    }
+    // A stale socket left by a crashed instance with the same display.
+    unlink(addr.sun_path);
+    if (bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0 || listen(fd, 4) < 0) {
+        close(fd);
+        return false;
+    }
+
+    server->stats_fd = fd;
+    server->stats_path = addr.sun_path;
+    server->stats_socket = wl_event_loop_add_fd(
+        wl_display_get_event_loop(server->display),
+        fd,
+        WL_EVENT_READABLE,
+        stats_handle_connection,
+        server
+    );
+    return true;
+}
+
+void stats_init(Server *server) {
+    histogram_init(&server->seat_stats.input_to_handled_usec);
+    histogram_init(&server->seat_stats.input_to_display_usec);
+    server->seat_stats.bad_timestamps = 0;
+
+    wl_event_loop *loop = wl_display_get_event_loop(server->display);
+    server->stats_signal = wl_event_loop_add_signal(loop, SIGUSR1, stats_handle_signal, server);
+    server->terminate_signals[0] = wl_event_loop_add_signal(
+        loop,
+        SIGINT,
+        stats_handle_terminate,
+        server
+    );
+    server->terminate_signals[1] = wl_event_loop_add_signal(
+        loop,
+        SIGTERM,
+        stats_handle_terminate,
+        server
+    );
+    server->stats_fd = -1;
+    server->stats_socket = NULL;
+    if (stats_open_socket(server)) {
+        wlr_log(WLR_INFO, "Frame statistics available at %s", server->stats_path.c_str());
+    } else {
+        wlr_log(WLR_ERROR, "Failed to open the frame statistics socket");
+    }
+}
+
+void stats_finish(Server *server) {
+    if (server->stats_signal != NULL) {
+        wl_event_source_remove(server->stats_signal);
+        server->stats_signal = NULL;
+    }
+    for (wl_event_source *&source : server->terminate_signals) {
+        if (source != NULL) {
+            wl_event_source_remove(source);
+            source = NULL;
+        }
+    }
+    if (server->stats_socket != NULL) {
+        wl_event_source_remove(server->stats_socket);
+        server->stats_socket = NULL;
+    }
+    if (server->stats_fd >= 0) {
+        close(server->stats_fd);
+        unlink(server->stats_path.c_str());
+        server->stats_fd = -1;
+    }
+}
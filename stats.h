@@ -0,0 +1,68 @@
+// Copyright © 2020 Mateus Carmo Martins de Freitas Barbosa
+//
+// This program is licensed under the GNU General Public License, version 3.
+// See LICENSE.txt.
+//
+
+#ifndef STACKTILE_STATS_H
+#define STACKTILE_STATS_H
+
+#include <stdint.h>
+#include <string>
+#include "histogram.h"
+struct wlr_surface;
+struct Output;
+struct Server;
+struct Surface;
+
+// Frame timing of a single output, dumped on SIGUSR1 and served to anyone
+// connecting to the stats socket.
+struct OutputStats {
+    // CPU time spent compositing a frame.
+    Histogram render_usec;
+    // From the frame event to the end of the commit, including the delay
+    // before the repaint.
+    Histogram frame_to_commit_usec;
+    Histogram views_drawn;
+    Histogram surfaces_drawn;
+
+    uint64_t frames_composited;
+    uint64_t frames_scanned_out;
+    // Frame events that didn't lead to a commit, because nothing was
+    // damaged or a transaction held the output.
+    uint64_t frames_skipped;
+    uint64_t frames_blocked;
+    uint64_t commit_failures;
+};
+
+void output_stats_init(OutputStats *stats);
+
+// Input latency of the seat, measured from the timestamps input devices put
+// on their events, which are CLOCK_MONOTONIC milliseconds.
+struct SeatStats {
+    // Until the event was forwarded to a client or taken by a keybinding
+    // or a grab, including the wait for the end of the pointer frame.
+    Histogram input_to_handled_usec;
+    // Until an output commit shows the first commit of the surface that
+    // got the event, which is the whole round-trip through the client.
+    Histogram input_to_display_usec;
+    // Events stamped by another clock, like the host's when nested.
+    uint64_t bad_timestamps;
+};
+
+// Called once an input event has been dealt with. target is the surface it
+// was sent to, if any, which is then waited on to respond.
+void stats_input_handled(Server *server, uint32_t time_msec, wlr_surface *target);
+void stats_surface_commit(Surface *surface);
+// Called after each successful commit of the output, with the surfaces it
+// shows in output->visible.
+void stats_output_commit(Output *output, int64_t now_nsec);
+
+// Sets up the SIGUSR1 handler and the socket, at
+// $XDG_RUNTIME_DIR/stacktile-$WAYLAND_DISPLAY.stats.
+void stats_init(Server *server);
+void stats_finish(Server *server);
+
+std::string stats_dump(Server *server);
+
+#endif /* STACKTILE_STATS_H */
@@ -0,0 +1,185 @@
+// Copyright © 2020 Mateus Carmo Martins de Freitas Barbosa
+//
+// This program is licensed under the GNU General Public License, version 3.
+// See LICENSE.txt.
+//
+
+#include <time.h>
+#include <algorithm>
+#include <wayland-server-core.h>
+
+extern "C" {
+#define static
+
+#include <wlr/types/wlr_box.h>
+#include <wlr/types/wlr_surface.h>
+#include <wlr/types/wlr_xdg_shell.h>
+
+#undef static
+}
+
+#include "output.h"
+#include "renderlist.h"
+#include "server.h"
+#include "stats.h"
+#include "surface.h"
+#include "swrender.h"
+#include "trace.h"
+#include "transaction.h"
+#include "view.h"
+
+static void hidden_frame_done_iterator(wlr_surface *_wlr_surface,
+                                       int sx, int sy,
+                                       void *data) {
+    auto surface = reinterpret_cast<Surface*>(_wlr_surface->data);
+    if (surface != NULL && surface->visible_outputs == 0) {
+        wlr_surface_send_frame_done(_wlr_surface, reinterpret_cast<timespec*>(data));
+    }
+}
+
+int surfaces_send_hidden_frame_done(void *data) {
+    auto server = reinterpret_cast<Server*>(data);
+    server->hidden_frame_timer_armed = false;
+
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    View *view;
+    wl_list_for_each(view, &server->views, link) {
+        if (!view->mapped) {
+            continue;
+        }
+        wlr_xdg_surface_for_each_surface(
+            view->xdg_surface,
+            hidden_frame_done_iterator,
+            &now
+        );
+    }
+    return 0;
+}
+
+void surface_schedule_hidden_frame(Surface *surface) {
+    Server *server = surface->server;
+    if (server->hidden_frame_timer_armed || server->hidden_frame_rate <= 0 ||
+        wl_list_empty(&surface->surface->current.frame_callback_list)) {
+        return;
+    }
+    int delay = 1000 / server->hidden_frame_rate;
+    wl_event_source_timer_update(server->hidden_frame_timer, delay > 0 ? delay : 1);
+    server->hidden_frame_timer_armed = true;
+}
+
+void surface_update_outputs(Surface *surface, const wlr_box *box) {
+    int64_t largest = 0;
+    uint32_t entered = 0;
+    surface->primary_output = 0;
+
+    Output *output;
+    wl_list_for_each(output, &surface->server->outputs, link) {
+        wlr_box intersection;
+        if (!wlr_box_intersection(&intersection, &output->layout_box, box)) {
+            if (surface->entered_outputs & output->mask) {
+                wlr_surface_send_leave(surface->surface, output->output);
+            }
+            continue;
+        }
+        if (output->mask != 0 && !(surface->entered_outputs & output->mask)) {
+            wlr_surface_send_enter(surface->surface, output->output);
+        }
+        entered |= output->mask;
+        int64_t area = static_cast<int64_t>(intersection.width) * intersection.height;
+        if (area > largest) {
+            largest = area;
+            surface->primary_output = output->mask;
+        }
+    }
+    // Bits of outputs that are gone are dropped here too, before another
+    // output can take them over.
+    surface->entered_outputs = entered;
+}
+
+void surface_leave_outputs(Surface *surface) {
+    Output *output;
+    wl_list_for_each(output, &surface->server->outputs, link) {
+        if (surface->entered_outputs & output->mask) {
+            wlr_surface_send_leave(surface->surface, output->output);
+        }
+    }
+    surface->entered_outputs = 0;
+}
+
+uint32_t surface_frame_output(Surface *surface) {
+    if (surface->visible_outputs & surface->primary_output) {
+        return surface->primary_output;
+    }
+    // Lowest visible bit.
+    return surface->visible_outputs & -surface->visible_outputs;
+}
+
+static void surface_commit(wl_listener *listener, void *data) {
+    TRACE_SCOPE("surface_commit");
+    Surface *surface = wl_container_of(listener, surface, commit);
+    surface->server->surface_commits++;
+    stats_surface_commit(surface);
+    if (surface->server->software_render) {
+        swrender_surface_commit(surface);
+    }
+    View *view = view_from_surface(surface->surface);
+    if (view == NULL || !view->mapped) {
+        return;
+    }
+    view_damage_surface(view, surface->surface);
+    if (surface->surface == view->xdg_surface->surface) {
+        transaction_notify_commit(view);
+    }
+    if (surface->visible_outputs == 0) {
+        surface_schedule_hidden_frame(surface);
+    }
+}
+
+static void surface_destroy(wl_listener *listener, void *data) {
+    Surface *surface = wl_container_of(listener, surface, destroy);
+    if (surface->visible_outputs != 0) {
+        Output *output;
+        wl_list_for_each(output, &surface->server->outputs, link) {
+            if (surface->visible_outputs & output->mask) {
+                output->visible.erase(
+                    std::remove(output->visible.begin(), output->visible.end(), surface),
+                    output->visible.end()
+                );
+            }
+        }
+    }
+    // Only the view the surface belongs to has an entry for it. Its
+    // parents are still there to tell which one that is.
+    View *view = view_from_surface(surface->surface);
+    if (view != NULL) {
+        render_list_invalidate_view(view);
+    }
+    surface->surface->data = NULL;
+    wl_list_remove(&surface->commit.link);
+    wl_list_remove(&surface->destroy.link);
+    delete surface;
+}
+
+void handle_new_surface(wl_listener *listener, void *data) {
+    Server *server = wl_container_of(listener, server, new_surface);
+    auto _wlr_surface = reinterpret_cast<wlr_surface*>(data);
+
+    Surface *surface = new Surface;
+    surface->server = server;
+    surface->surface = _wlr_surface;
+    surface->visible_outputs = 0;
+    surface->primary_output = 0;
+    surface->entered_outputs = 0;
+    surface->pixels.width = 0;
+    surface->pixels.height = 0;
+    surface->pixels.opaque = false;
+    surface->input_state = SURFACE_INPUT_IDLE;
+    surface->input_usec = 0;
+    _wlr_surface->data = surface;
+
+    surface->commit.notify = surface_commit;
+    wl_signal_add(&_wlr_surface->events.commit, &surface->commit);
+    surface->destroy.notify = surface_destroy;
+    wl_signal_add(&_wlr_surface->events.destroy, &surface->destroy);
+}
@@ -0,0 +1,64 @@
+// Copyright © 2020 Mateus Carmo Martins de Freitas Barbosa
+//
+// This program is licensed under the GNU General Public License, version 3.
+// See LICENSE.txt.
+//
+
+#ifndef STACKTILE_SURFACE_H
+#define STACKTILE_SURFACE_H
+
+#include <stdint.h>
+#include <wayland-server-core.h>
+#include "swrender.h"
+struct wlr_box;
+struct wlr_surface;
+struct Server;
+
+enum SurfaceInputState {
+    SURFACE_INPUT_IDLE,
+    // Got input, which the client hasn't committed a response to.
+    SURFACE_INPUT_WAITING,
+    // Committed since, but no output has shown it yet.
+    SURFACE_INPUT_COMMITTED,
+};
+
+// Compositor-side state attached to every wlr_surface, including
+// subsurfaces and popups. It's reachable through wlr_surface->data.
+struct Surface {
+    Server *server;
+    wlr_surface *surface;
+    wl_listener commit;
+    wl_listener destroy;
+    // One bit per output (see Output::mask) the surface is visible on.
+    uint32_t visible_outputs;
+    // The bit of the output the surface overlaps the most, which is the
+    // one it gets frame callbacks from.
+    uint32_t primary_output;
+    // The outputs the surface overlaps, hidden or not, which the client
+    // was told about with wl_surface.enter. It renders at their scale.
+    uint32_t entered_outputs;
+    // Only kept up to date when server->software_render is set.
+    SoftwarePixels pixels;
+    // For the input latency stats, see stats_input_handled. input_usec
+    // is when the oldest event the surface is responding to happened.
+    SurfaceInputState input_state;
+    int64_t input_usec;
+};
+
+void handle_new_surface(wl_listener *listener, void *data);
+
+// Takes the surface's box in layout coordinates. Sends enter and leave
+// events for the outputs it started or stopped overlapping.
+void surface_update_outputs(Surface *surface, const wlr_box *box);
+// Sends leave events for every output, for surfaces that are unmapped.
+void surface_leave_outputs(Surface *surface);
+// Returns the bit of the output that sends the surface's frame callbacks:
+// the primary output, or another one if the surface is hidden there.
+uint32_t surface_frame_output(Surface *surface);
+
+// Hidden surfaces don't get frame callbacks from output repaints, only from
+// a timer running at server->hidden_frame_rate while any of them waits.
+void surface_schedule_hidden_frame(Surface *surface);
+int surfaces_send_hidden_frame_done(void *data);
+
+#endif /* STACKTILE_SURFACE_H */
@@ -0,0 +1,350 @@
+// Copyright © 2020 Mateus Carmo Martins de Freitas Barbosa
+//
+// This program is licensed under the GNU General Public License, version 3.
+// See LICENSE.txt.
+//
+
+#include <string.h>
+#include <algorithm>
+#include <functional>
+#include <vector>
+#include <wayland-server-core.h>
+
+extern "C" {
+#define static
+
+#include <wlr/render/wlr_renderer.h>
+#include <wlr/render/wlr_texture.h>
+#include <wlr/types/wlr_matrix.h>
+#include <wlr/types/wlr_output.h>
+#include <wlr/types/wlr_output_damage.h>
+#include <wlr/types/wlr_surface.h>
+
+#undef static
+}
+
+#include "blend.h"
+#include "output.h"
+#include "server.h"
+#include "surface.h"
+#include "swrender.h"
+#include "threadpool.h"
+#include "trace.h"
+
+// Small enough for a 4K output to keep dozens of threads busy, big enough
+// for the per-tile region work not to matter.
+static const int TILE_SIZE = 128;
+// The renderer clears to the same colour.
+static const uint32_t BACKGROUND = 0xff4d4d4d;
+
+void software_frame_init(SoftwareFrame *frame) {
+    frame->width = 0;
+    frame->height = 0;
+    frame->texture = NULL;
+    frame->valid = false;
+}
+
+void software_frame_finish(SoftwareFrame *frame) {
+    if (frame->texture != NULL) {
+        wlr_texture_destroy(frame->texture);
+        frame->texture = NULL;
+    }
+    frame->pixels.clear();
+    frame->valid = false;
+}
+
+static void copy_rect(SoftwarePixels *pixels,
+                      const uint8_t *data,
+                      int stride,
+                      const pixman_box32_t *rect) {
+    int x1 = std::max(rect->x1, 0), x2 = std::min(rect->x2, pixels->width);
+    int y1 = std::max(rect->y1, 0), y2 = std::min(rect->y2, pixels->height);
+    if (x1 >= x2) {
+        return;
+    }
+    for (int y = y1; y < y2; y++) {
+        memcpy(
+            &pixels->data[static_cast<size_t>(y) * pixels->width + x1],
+            data + static_cast<size_t>(y) * stride + x1 * 4,
+            (x2 - x1) * 4
+        );
+    }
+}
+
+void swrender_surface_commit(Surface *surface) {
+    wlr_surface *_wlr_surface = surface->surface;
+    if (!(_wlr_surface->current.committed & WLR_SURFACE_STATE_BUFFER)) {
+        // Same buffer as before, which the client may be drawing into by
+        // now.
+        return;
+    }
+    SoftwarePixels *pixels = &surface->pixels;
+    wl_shm_buffer *shm = NULL;
+    if (_wlr_surface->buffer != NULL && _wlr_surface->buffer->resource != NULL) {
+        shm = wl_shm_buffer_get(_wlr_surface->buffer->resource);
+    }
+    uint32_t format = shm != NULL ? wl_shm_buffer_get_format(shm) : 0;
+    if (shm == NULL ||
+        (format != WL_SHM_FORMAT_ARGB8888 && format != WL_SHM_FORMAT_XRGB8888)) {
+        // Only the renderer can draw this one.
+        pixels->data.clear();
+        pixels->width = 0;
+        pixels->height = 0;
+        return;
+    }
+
+    int width = wl_shm_buffer_get_width(shm);
+    int height = wl_shm_buffer_get_height(shm);
+    int stride = wl_shm_buffer_get_stride(shm);
+    pixman_box32_t whole { 0, 0, width, height };
+    bool resized = width != pixels->width || height != pixels->height;
+    pixels->width = width;
+    pixels->height = height;
+    pixels->opaque = format == WL_SHM_FORMAT_XRGB8888;
+    if (resized) {
+        pixels->data.resize(static_cast<size_t>(width) * height);
+    }
+
+    wl_shm_buffer_begin_access(shm);
+    auto data = static_cast<const uint8_t*>(wl_shm_buffer_get_data(shm));
+    if (resized) {
+        copy_rect(pixels, data, stride, &whole);
+    } else {
+        // Pixels outside of the buffer damage are the same as in the
+        // previous buffer.
+        int nrects;
+        pixman_box32_t *rects = pixman_region32_rectangles(&_wlr_surface->buffer_damage, &nrects);
+        for (int i = 0; i < nrects; i++) {
+            copy_rect(pixels, data, stride, &rects[i]);
+        }
+    }
+    wl_shm_buffer_end_access(shm);
+}
+
+static bool entry_is_drawable(const RenderEntry *entry) {
+    auto surface = reinterpret_cast<Surface*>(entry->surface->data);
+    return surface != NULL && !surface->pixels.data.empty() &&
+        entry->transform == WL_OUTPUT_TRANSFORM_NORMAL &&
+        entry->box.width > 0 && entry->box.height > 0;
+}
+
+// Draws the part of the entry inside rect, which lies within the entry's
+// box. Buffers with a different size than their box are sampled at the
+// nearest pixel.
+static void composite_rect(SoftwareFrame *frame,
+                           const RenderEntry *entry,
+                           const pixman_box32_t *rect,
+                           uint32_t *row) {
+    const SoftwarePixels *pixels = &reinterpret_cast<Surface*>(entry->surface->data)->pixels;
+    const wlr_box *box = &entry->box;
+    int width = rect->x2 - rect->x1;
+    bool scaled = pixels->width != box->width || pixels->height != box->height;
+    uint32_t alpha = entry->alpha >= 1.0 ? 255 : static_cast<uint32_t>(entry->alpha * 255 + 0.5);
+
+    for (int y = rect->y1; y < rect->y2; y++) {
+        int sy = static_cast<int64_t>(y - box->y) * pixels->height / box->height;
+        const uint32_t *src_row = &pixels->data[static_cast<size_t>(sy) * pixels->width];
+        const uint32_t *src;
+        if (scaled) {
+            for (int x = rect->x1; x < rect->x2; x++) {
+                row[x - rect->x1] = src_row[static_cast<int64_t>(x - box->x) * pixels->width / box->width];
+            }
+            src = row;
+        } else {
+            src = src_row + (rect->x1 - box->x);
+        }
+
+        uint32_t *dst = &frame->pixels[static_cast<size_t>(y) * frame->width + rect->x1];
+        if (pixels->opaque && alpha == 255) {
+            blend_copy_opaque(dst, src, width);
+        } else if (pixels->opaque) {
+            if (src != row) {
+                memcpy(row, src, width * 4);
+                src = row;
+            }
+            for (int x = 0; x < width; x++) {
+                row[x] |= 0xff000000;
+            }
+            blend_over_alpha(dst, src, width, alpha);
+        } else if (alpha == 255) {
+            blend_over(dst, src, width);
+        } else {
+            blend_over_alpha(dst, src, width, alpha);
+        }
+    }
+}
+
+// Repaints the part of region within the tile, back-to-front. Runs on the
+// pool, so it must only touch the tile's own pixels.
+static void composite_tile(SoftwareFrame *frame,
+                           const pixman_box32_t *tile,
+                           pixman_region32_t *region,
+                           RenderEntry *entries,
+                           size_t count,
+                           pixman_region32_t *uncovered) {
+    TRACE_SCOPE("composite_tile");
+    uint32_t row[TILE_SIZE];
+
+    pixman_region32_t tile_damage, part;
+    pixman_region32_init_rect(
+        &tile_damage,
+        tile->x1,
+        tile->y1,
+        tile->x2 - tile->x1,
+        tile->y2 - tile->y1
+    );
+    pixman_region32_intersect(&tile_damage, &tile_damage, region);
+    pixman_region32_init(&part);
+
+    pixman_region32_intersect(&part, &tile_damage, uncovered);
+    int nrects;
+    pixman_box32_t *rects = pixman_region32_rectangles(&part, &nrects);
+    for (int i = 0; i < nrects; i++) {
+        for (int y = rects[i].y1; y < rects[i].y2; y++) {
+            blend_fill(
+                &frame->pixels[static_cast<size_t>(y) * frame->width + rects[i].x1],
+                rects[i].x2 - rects[i].x1,
+                BACKGROUND
+            );
+        }
+    }
+
+    for (size_t i = count; i-- > 0;) {
+        pixman_region32_intersect(&part, &tile_damage, &entries[i].damage);
+        rects = pixman_region32_rectangles(&part, &nrects);
+        for (int j = 0; j < nrects; j++) {
+            composite_rect(frame, &entries[i], &rects[j], row);
+        }
+    }
+    pixman_region32_fini(&part);
+    pixman_region32_fini(&tile_damage);
+}
+
+static void upload(Output *output, pixman_region32_t *region) {
+    TRACE_SCOPE("software_upload");
+    SoftwareFrame *frame = &output->software;
+    uint32_t stride = frame->width * 4;
+    if (frame->texture == NULL) {
+        frame->texture = wlr_texture_from_pixels(
+            output->server->renderer,
+            WL_SHM_FORMAT_ARGB8888,
+            stride,
+            frame->width,
+            frame->height,
+            frame->pixels.data()
+        );
+        return;
+    }
+    int nrects;
+    pixman_box32_t *rects = pixman_region32_rectangles(region, &nrects);
+    for (int i = 0; i < nrects; i++) {
+        wlr_texture_write_pixels(
+            frame->texture,
+            stride,
+            rects[i].x2 - rects[i].x1,
+            rects[i].y2 - rects[i].y1,
+            rects[i].x1,
+            rects[i].y1,
+            rects[i].x1,
+            rects[i].y1,
+            frame->pixels.data()
+        );
+    }
+}
+
+bool swrender_needs_whole_frame(Output *output) {
+    SoftwareFrame *frame = &output->software;
+    int width, height;
+    wlr_output_transformed_resolution(output->output, &width, &height);
+    return !frame->valid || width != frame->width || height != frame->height;
+}
+
+bool swrender_composite(Output *output,
+                        RenderEntry *entries,
+                        size_t count,
+                        pixman_region32_t *uncovered) {
+    TRACE_SCOPE("software_composite");
+    SoftwareFrame *frame = &output->software;
+    wlr_output *_wlr_output = output->output;
+    bool drawable = _wlr_output->transform == WL_OUTPUT_TRANSFORM_NORMAL;
+    for (size_t i = 0; drawable && i < count; i++) {
+        drawable = entry_is_drawable(&entries[i]);
+    }
+    if (!drawable) {
+        frame->valid = false;
+        return false;
+    }
+
+    int width, height;
+    wlr_output_transformed_resolution(_wlr_output, &width, &height);
+    bool whole = swrender_needs_whole_frame(output);
+    if (width != frame->width || height != frame->height) {
+        software_frame_finish(frame);
+        frame->width = width;
+        frame->height = height;
+        frame->pixels.resize(static_cast<size_t>(width) * height);
+    }
+
+    // Our frame is a single buffer, so only what changed since the last
+    // commit needs compositing, however old the back buffer is.
+    pixman_region32_t region;
+    pixman_region32_init(&region);
+    if (whole) {
+        pixman_region32_union_rect(&region, &region, 0, 0, width, height);
+    } else {
+        pixman_region32_intersect_rect(&region, &output->damage->current, 0, 0, width, height);
+    }
+
+    std::vector<pixman_box32_t> tiles;
+    for (int y = 0; y < height; y += TILE_SIZE) {
+        for (int x = 0; x < width; x += TILE_SIZE) {
+            pixman_box32_t tile {
+                x,
+                y,
+                std::min(x + TILE_SIZE, width),
+                std::min(y + TILE_SIZE, height),
+            };
+            if (pixman_region32_contains_rectangle(&region, &tile) != PIXMAN_REGION_OUT) {
+                tiles.push_back(tile);
+            }
+        }
+    }
+    std::function<void(int)> job = [&](int i) {
+        composite_tile(frame, &tiles[i], &region, entries, count, uncovered);
+    };
+    thread_pool_run(&output->server->render_pool, tiles.size(), job);
+
+    upload(output, &region);
+    pixman_region32_fini(&region);
+    frame->valid = frame->texture != NULL;
+    return frame->valid;
+}
+
+void swrender_draw(Output *output, pixman_region32_t *damage) {
+    wlr_output *_wlr_output = output->output;
+    wlr_renderer *renderer = output->server->renderer;
+    SoftwareFrame *frame = &output->software;
+    wlr_box box { 0, 0, frame->width, frame->height };
+    float matrix[9];
+    wlr_matrix_project_box(
+        matrix,
+        &box,
+        WL_OUTPUT_TRANSFORM_NORMAL,
+        0,
+        _wlr_output->transform_matrix
+    );
+
+    // Only normal outputs get here, so damage needs no transforming.
+    int nrects;
+    pixman_box32_t *rects = pixman_region32_rectangles(damage, &nrects);
+    for (int i = 0; i < nrects; i++) {
+        wlr_box scissor {
+            rects[i].x1,
+            rects[i].y1,
+            rects[i].x2 - rects[i].x1,
+            rects[i].y2 - rects[i].y1,
+        };
+        wlr_renderer_scissor(renderer, &scissor);
+        wlr_render_texture_with_matrix(renderer, frame->texture, matrix, 1.0);
+    }
+}
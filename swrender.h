@@ -0,0 +1,65 @@
+// Copyright © 2020 Mateus Carmo Martins de Freitas Barbosa
+//
+// This program is licensed under the GNU General Public License, version 3.
+// See LICENSE.txt.
+//
+
+#ifndef STACKTILE_SWRENDER_H
+#define STACKTILE_SWRENDER_H
+
+#include <pixman.h>
+#include <stdint.h>
+#include <vector>
+struct wlr_texture;
+struct Output;
+struct RenderEntry;
+struct Server;
+struct Surface;
+
+// Software composition, for headless and GPU-less seats where the renderer
+// is a rasterizer drawing one surface at a time. The damaged part of the
+// output is composited on the CPU instead, in tiles spread over
+// server->render_pool, and the renderer only gets to draw the result as a
+// single texture.
+
+// The latest shm buffer of a surface, copied when it's committed, since the
+// client may reuse it as soon as it's released.
+struct SoftwarePixels {
+    std::vector<uint32_t> data;
+    int width, height;
+    // XRGB buffers, whose alpha channel is garbage.
+    bool opaque;
+};
+
+// What the output shows, kept between frames so that only damage needs to
+// be composited and uploaded.
+struct SoftwareFrame {
+    std::vector<uint32_t> pixels;
+    int width, height;
+    wlr_texture *texture;
+    // False when pixels are out of date outside of the frame damage, after
+    // a frame composited by the renderer or a resize.
+    bool valid;
+};
+
+void software_frame_init(SoftwareFrame *frame);
+void software_frame_finish(SoftwareFrame *frame);
+
+void swrender_surface_commit(Surface *surface);
+
+// Whether the frame has to be composited whole rather than just its damage,
+// which the caller has to account for before collecting the entries.
+bool swrender_needs_whole_frame(Output *output);
+// Composites entries, front-to-back as collect_visible leaves them, over the
+// background showing through uncovered, and uploads the result. Returns
+// false without touching anything when some entry can't be drawn on the
+// CPU, leaving the frame to the renderer.
+bool swrender_composite(Output *output,
+                        RenderEntry *entries,
+                        size_t count,
+                        pixman_region32_t *uncovered);
+// Draws the composited frame over damage, between wlr_renderer_begin and
+// wlr_renderer_end.
+void swrender_draw(Output *output, pixman_region32_t *damage);
+
+#endif /* STACKTILE_SWRENDER_H */
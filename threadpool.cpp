@@ -0,0 +1,91 @@
+// Copyright © 2020 Mateus Carmo Martins de Freitas Barbosa
+//
+// This program is licensed under the GNU General Public License, version 3.
+// See LICENSE.txt.
+//
+
+#include "threadpool.h"
+
+static void run_jobs(ThreadPool *pool) {
+    for (;;) {
+        int i = pool->next.fetch_add(1, std::memory_order_relaxed);
+        if (i >= pool->count) {
+            return;
+        }
+        (*pool->job)(i);
+    }
+}
+
+static void worker(ThreadPool *pool) {
+    uint64_t seen = 0;
+    std::unique_lock<std::mutex> lock(pool->mutex);
+    for (;;) {
+        pool->start.wait(lock, [&] {
+            return pool->stopping || pool->generation != seen;
+        });
+        if (pool->stopping) {
+            return;
+        }
+        seen = pool->generation;
+        lock.unlock();
+        run_jobs(pool);
+        lock.lock();
+        if (--pool->busy == 0) {
+            pool->done.notify_one();
+        }
+    }
+}
+
+void thread_pool_init(ThreadPool *pool, int threads) {
+    if (threads <= 0) {
+        threads = std::thread::hardware_concurrency();
+    }
+    pool->job = NULL;
+    pool->count = 0;
+    pool->next = 0;
+    pool->busy = 0;
+    pool->generation = 0;
+    pool->stopping = false;
+    for (int i = 1; i < threads; i++) {
+        pool->threads.emplace_back(worker, pool);
+    }
+}
+
+void thread_pool_finish(ThreadPool *pool) {
+    {
+        std::lock_guard<std::mutex> lock(pool->mutex);
+        pool->stopping = true;
+    }
+    pool->start.notify_all();
+    for (std::thread &thread : pool->threads) {
+        thread.join();
+    }
+    pool->threads.clear();
+}
+
+int thread_pool_size(const ThreadPool *pool) {
+    return pool->threads.size() + 1;
+}
+
+void thread_pool_run(ThreadPool *pool, int count, const std::function<void(int)> &job) {
+    if (count <= 1 || pool->threads.empty()) {
+        // Not worth waking anyone up.
+        for (int i = 0; i < count; i++) {
+            job(i);
+        }
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(pool->mutex);
+        pool->job = &job;
+        pool->count = count;
+        pool->next = 0;
+        pool->busy = pool->threads.size();
+        pool->generation++;
+    }
+    pool->start.notify_all();
+    run_jobs(pool);
+
+    std::unique_lock<std::mutex> lock(pool->mutex);
+    pool->done.wait(lock, [&] { return pool->busy == 0; });
+}
@@ -0,0 +1,45 @@
+// Copyright © 2020 Mateus Carmo Martins de Freitas Barbosa
+//
+// This program is licensed under the GNU General Public License, version 3.
+// See LICENSE.txt.
+//
+
+#ifndef STACKTILE_THREADPOOL_H
+#define STACKTILE_THREADPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <stdint.h>
+#include <thread>
+#include <vector>
+
+// A fixed set of threads that run a batch of independent jobs at a time,
+// together with the thread that hands the batch out. Jobs are picked off a
+// shared counter, so uneven ones balance themselves out.
+struct ThreadPool {
+    std::vector<std::thread> threads;
+    std::mutex mutex;
+    std::condition_variable start;
+    std::condition_variable done;
+    // The batch being run.
+    const std::function<void(int)> *job;
+    int count;
+    std::atomic<int> next;
+    // Workers that haven't finished the batch yet.
+    int busy;
+    uint64_t generation;
+    bool stopping;
+};
+
+// threads counts the caller too, 0 means one per core.
+void thread_pool_init(ThreadPool *pool, int threads);
+void thread_pool_finish(ThreadPool *pool);
+int thread_pool_size(const ThreadPool *pool);
+
+// Calls job(i) for every i in [0, count), returning once all are done.
+// Only one thread may run batches on a pool.
+void thread_pool_run(ThreadPool *pool, int count, const std::function<void(int)> &job);
+
+#endif /* STACKTILE_THREADPOOL_H */
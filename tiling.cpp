@@ -0,0 +1,454 @@
+// Copyright © 2020 Mateus Carmo Martins de Freitas Barbosa
+//
+// This program is licensed under the GNU General Public License, version 3.
+// See LICENSE.txt.
+//
+
+#include <math.h>
+#include <stddef.h>
+#include <algorithm>
+
+#include "tiling.h"
+
+// No node gets squeezed below this share of its parent by tile_grow.
+static const double MIN_SHARE = 0.05;
+
+void tile_window_init(TileWindow *window, void *data) {
+    window->tree = NULL;
+    window->stack = NULL;
+    window->box = { 0, 0, 0, 0 };
+    window->changed = false;
+    window->data = data;
+}
+
+void tile_tree_init(TileTree *tree) {
+    tree->root = NULL;
+    tree->area = { 0, 0, 0, 0 };
+}
+
+static void free_node(TileNode *node) {
+    for (TileNode *child : node->children) {
+        free_node(child);
+    }
+    delete node;
+}
+
+void tile_tree_finish(TileTree *tree) {
+    if (tree->root != NULL) {
+        free_node(tree->root);
+        tree->root = NULL;
+    }
+    tree->changed.clear();
+}
+
+static TileNode *node_create(TileNode *parent, TileSplit split, double weight) {
+    TileNode *node = new TileNode;
+    node->parent = parent;
+    node->split = split;
+    node->weight = weight;
+    node->box = { 0, 0, 0, 0 };
+    node->active = NULL;
+    return node;
+}
+
+static void set_window_box(TileTree *tree, TileWindow *window, const Box *box) {
+    if (box_equal(&window->box, box)) {
+        return;
+    }
+    window->box = *box;
+    if (!window->changed) {
+        window->changed = true;
+        tree->changed.push_back(window);
+    }
+}
+
+// Children whose box stays the same are skipped, since nothing below them
+// can have changed unless they're the node a change started from, which
+// is laid out with force.
+static void layout(TileTree *tree, TileNode *node, const Box *box, bool force) {
+    if (!force && box_equal(&node->box, box)) {
+        return;
+    }
+    node->box = *box;
+    if (node->split == TILE_STACK) {
+        for (TileWindow *window : node->windows) {
+            set_window_box(tree, window, box);
+        }
+        return;
+    }
+
+    double total = 0;
+    for (TileNode *child : node->children) {
+        total += child->weight;
+    }
+    bool horizontal = node->split == TILE_SPLIT_HORIZONTAL;
+    int start = horizontal ? box->x : box->y;
+    int length = horizontal ? box->width : box->height;
+    // Edges are rounded from the running sum, so that the children add up
+    // to the box exactly and moving one edge leaves the others alone.
+    double sum = 0;
+    int position = start;
+    for (size_t i = 0; i < node->children.size(); i++) {
+        sum += node->children[i]->weight;
+        int end = i + 1 == node->children.size() ?
+            start + length :
+            start + static_cast<int>(lround(length * sum / total));
+        Box child_box = horizontal ?
+            Box { position, box->y, end - position, box->height } :
+            Box { box->x, position, box->width, end - position };
+        layout(tree, node->children[i], &child_box, false);
+        position = end;
+    }
+}
+
+static void relayout(TileTree *tree, TileNode *node) {
+    Box box = node->parent == NULL ? tree->area : node->box;
+    layout(tree, node, &box, true);
+}
+
+void tile_tree_set_area(TileTree *tree, const Box *area) {
+    tree->area = *area;
+    if (tree->root != NULL) {
+        layout(tree, tree->root, area, false);
+    }
+}
+
+void tile_tree_clear_changed(TileTree *tree) {
+    for (TileWindow *window : tree->changed) {
+        window->changed = false;
+    }
+    tree->changed.clear();
+}
+
+static void collect_windows(const TileNode *node, std::vector<TileWindow*> *windows) {
+    windows->insert(windows->end(), node->windows.begin(), node->windows.end());
+    for (const TileNode *child : node->children) {
+        collect_windows(child, windows);
+    }
+}
+
+void tile_tree_windows(const TileTree *tree, std::vector<TileWindow*> *windows) {
+    if (tree->root != NULL) {
+        collect_windows(tree->root, windows);
+    }
+}
+
+static size_t child_index(const TileNode *parent, const TileNode *child) {
+    return std::find(parent->children.begin(), parent->children.end(), child) -
+        parent->children.begin();
+}
+
+// New stacks give their windows a box once they're laid out.
+static void stack_add(TileTree *tree, TileNode *stack, TileWindow *window) {
+    window->tree = tree;
+    window->stack = stack;
+    stack->windows.push_back(window);
+    stack->active = window;
+}
+
+// Scales the children's weights to add up to 1, which keeps their shares
+// and stops repeated inserts and removals from drifting the sums away.
+static void normalize_weights(TileNode *parent) {
+    double total = 0;
+    for (TileNode *child : parent->children) {
+        total += child->weight;
+    }
+    for (TileNode *child : parent->children) {
+        child->weight /= total;
+    }
+}
+
+// Adds the stack to the parent's children at index, with the average share
+// of those already there. The others give up space in proportion to their
+// shares, which is what unlink_node gives back, so that opening and closing
+// a window leaves its siblings where they were.
+static void join_split(TileTree *tree, TileNode *parent, TileNode *stack, size_t index) {
+    stack->parent = parent;
+    // Weights add up to 1, so this is the average.
+    stack->weight = 1.0 / parent->children.size();
+    parent->children.insert(parent->children.begin() + index, stack);
+    normalize_weights(parent);
+    relayout(tree, parent);
+}
+
+// Puts the new stack next to node, before it when first is set. When the
+// parent isn't split that way, the two share node's part of the parent
+// in halves, and only that part is laid out again.
+static void split_node(TileTree *tree,
+                       TileNode *node,
+                       TileNode *stack,
+                       TileSplit split,
+                       bool first) {
+    TileNode *parent = node->parent;
+    if (parent == NULL || parent->split != split) {
+        // The node makes room for a split in its place.
+        TileNode *container = node_create(parent, split, node->weight);
+        container->box = node->box;
+        if (parent == NULL) {
+            tree->root = container;
+        } else {
+            parent->children[child_index(parent, node)] = container;
+        }
+        node->parent = container;
+        node->weight = 1;
+        container->children.push_back(node);
+        parent = container;
+    }
+
+    size_t index = child_index(parent, node);
+    join_split(tree, parent, stack, first ? index : index + 1);
+}
+
+static TileSplit split_along(const Box *box) {
+    return box->width >= box->height ? TILE_SPLIT_HORIZONTAL : TILE_SPLIT_VERTICAL;
+}
+
+void tile_insert_split(TileTree *tree, TileWindow *window, TileWindow *near) {
+    TileNode *stack = node_create(NULL, TILE_STACK, 1);
+    if (tree->root == NULL) {
+        tree->root = stack;
+        stack_add(tree, stack, window);
+        relayout(tree, stack);
+        return;
+    }
+    if (near != NULL && near->tree == tree) {
+        stack_add(tree, stack, window);
+        split_node(tree, near->stack, stack, split_along(&near->stack->box), false);
+        return;
+    }
+    stack_add(tree, stack, window);
+
+    TileNode *root = tree->root;
+    TileSplit split = split_along(&tree->area);
+    if (root->split != split) {
+        split_node(tree, root, stack, split, false);
+        return;
+    }
+    // The root is split the same way already, so the window joins it.
+    join_split(tree, root, stack, root->children.size());
+}
+
+void tile_insert_stacked(TileWindow *window, TileWindow *near) {
+    stack_add(near->tree, near->stack, window);
+    set_window_box(near->tree, window, &near->stack->box);
+}
+
+// Takes the node out of its parent, which goes away too if a single child
+// is left, and lays out again whatever took its space.
+static void unlink_node(TileTree *tree, TileNode *node) {
+    TileNode *parent = node->parent;
+    if (parent == NULL) {
+        tree->root = NULL;
+        return;
+    }
+    size_t index = child_index(parent, node);
+    parent->children.erase(parent->children.begin() + index);
+    if (parent->children.size() > 1) {
+        // The siblings share the space in proportion, undoing join_split.
+        normalize_weights(parent);
+        relayout(tree, parent);
+        return;
+    }
+
+    TileNode *child = parent->children[0];
+    TileNode *grandparent = parent->parent;
+    child->parent = grandparent;
+    child->weight = parent->weight;
+    child->box = parent->box;
+    if (grandparent == NULL) {
+        tree->root = child;
+    } else {
+        grandparent->children[child_index(grandparent, parent)] = child;
+    }
+    parent->children.clear();
+    delete parent;
+    if (grandparent != NULL && grandparent->split == child->split) {
+        // The child's own children join the grandparent's, which are
+        // along the same axis.
+        size_t at = child_index(grandparent, child);
+        double total = 0;
+        for (TileNode *grandchild : child->children) {
+            total += grandchild->weight;
+        }
+        for (TileNode *grandchild : child->children) {
+            grandchild->parent = grandparent;
+            grandchild->weight = grandchild->weight / total * child->weight;
+        }
+        grandparent->children.erase(grandparent->children.begin() + at);
+        grandparent->children.insert(
+            grandparent->children.begin() + at,
+            child->children.begin(),
+            child->children.end()
+        );
+        child->children.clear();
+        delete child;
+        relayout(tree, grandparent);
+        return;
+    }
+    relayout(tree, child);
+}
+
+void tile_remove(TileWindow *window) {
+    TileTree *tree = window->tree;
+    if (tree == NULL) {
+        return;
+    }
+    TileNode *stack = window->stack;
+    window->tree = NULL;
+    window->stack = NULL;
+    if (window->changed) {
+        tree->changed.erase(std::find(tree->changed.begin(), tree->changed.end(), window));
+        window->changed = false;
+    }
+
+    stack->windows.erase(std::find(stack->windows.begin(), stack->windows.end(), window));
+    if (!stack->windows.empty()) {
+        if (stack->active == window) {
+            stack->active = stack->windows.back();
+        }
+        return;
+    }
+    unlink_node(tree, stack);
+    delete stack;
+}
+
+void tile_activate(TileWindow *window) {
+    if (window->stack != NULL) {
+        window->stack->active = window;
+    }
+}
+
+TileWindow *tile_stack_next(TileWindow *window) {
+    const std::vector<TileWindow*> &windows = window->stack->windows;
+    size_t index = std::find(windows.begin(), windows.end(), window) - windows.begin();
+    return windows[(index + 1) % windows.size()];
+}
+
+static TileSplit direction_split(uint32_t direction) {
+    return direction & (EDGE_LEFT | EDGE_RIGHT) ? TILE_SPLIT_HORIZONTAL : TILE_SPLIT_VERTICAL;
+}
+
+static bool direction_forward(uint32_t direction) {
+    return direction & (EDGE_RIGHT | EDGE_BOTTOM);
+}
+
+// Walks up to the first split along the direction's axis with a sibling
+// on that side, then down that sibling to the stack facing the window's
+// centre. Only the path is visited.
+static TileNode *neighbor_stack(TileNode *stack, uint32_t direction) {
+    TileSplit split = direction_split(direction);
+    bool forward = direction_forward(direction);
+    TileNode *node = stack;
+    TileNode *target = NULL;
+    while (node->parent != NULL && target == NULL) {
+        TileNode *parent = node->parent;
+        if (parent->split == split) {
+            size_t index = child_index(parent, node);
+            if (forward && index + 1 < parent->children.size()) {
+                target = parent->children[index + 1];
+            } else if (!forward && index > 0) {
+                target = parent->children[index - 1];
+            }
+        }
+        node = parent;
+    }
+    if (target == NULL) {
+        return NULL;
+    }
+
+    double center = split == TILE_SPLIT_HORIZONTAL ?
+        stack->box.y + stack->box.height / 2.0 :
+        stack->box.x + stack->box.width / 2.0;
+    while (target->split != TILE_STACK) {
+        if (target->split == split) {
+            target = forward ? target->children.front() : target->children.back();
+            continue;
+        }
+        TileNode *next = target->children.back();
+        for (TileNode *child : target->children) {
+            int end = split == TILE_SPLIT_HORIZONTAL ?
+                child->box.y + child->box.height :
+                child->box.x + child->box.width;
+            if (center < end) {
+                next = child;
+                break;
+            }
+        }
+        target = next;
+    }
+    return target;
+}
+
+TileWindow *tile_neighbor(TileWindow *window, uint32_t direction) {
+    if (window->stack == NULL) {
+        return NULL;
+    }
+    TileNode *stack = neighbor_stack(window->stack, direction);
+    return stack != NULL ? stack->active : NULL;
+}
+
+void tile_move(TileWindow *window, uint32_t direction) {
+    TileTree *tree = window->tree;
+    if (tree == NULL) {
+        return;
+    }
+    TileNode *stack = window->stack;
+    if (stack->windows.size() > 1) {
+        tile_remove(window);
+        TileNode *own = node_create(NULL, TILE_STACK, 1);
+        stack_add(tree, own, window);
+        split_node(tree, stack, own, direction_split(direction), !direction_forward(direction));
+        return;
+    }
+
+    TileNode *target = neighbor_stack(stack, direction);
+    if (target == NULL) {
+        return;
+    }
+    // Removing the window may move the target, but never frees it: the
+    // only stack that goes away is the window's own.
+    tile_remove(window);
+    stack_add(tree, target, window);
+    set_window_box(tree, window, &target->box);
+}
+
+void tile_grow(TileWindow *window, uint32_t direction, double amount) {
+    if (window->tree == NULL) {
+        return;
+    }
+    TileSplit split = direction_split(direction);
+    bool forward = direction_forward(direction);
+    TileNode *node = window->stack;
+    TileNode *parent = node->parent;
+    while (parent != NULL && parent->split != split) {
+        node = parent;
+        parent = node->parent;
+    }
+    if (parent == NULL) {
+        return;
+    }
+
+    // The space comes from the sibling on that side, or the other one for
+    // the last child, so that no other edge moves.
+    size_t index = child_index(parent, node);
+    TileNode *sibling;
+    if (forward) {
+        sibling = index + 1 < parent->children.size() ?
+            parent->children[index + 1] : parent->children[index - 1];
+    } else {
+        sibling = index > 0 ? parent->children[index - 1] : parent->children[index + 1];
+    }
+    double total = 0;
+    for (TileNode *child : parent->children) {
+        total += child->weight;
+    }
+    double min_delta = MIN_SHARE * total - node->weight;
+    double max_delta = sibling->weight - MIN_SHARE * total;
+    if (min_delta > max_delta) {
+        return;
+    }
+    double delta = std::max(min_delta, std::min(amount * total, max_delta));
+    node->weight += delta;
+    sibling->weight -= delta;
+    relayout(window->tree, parent);
+}
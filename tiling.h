@@ -0,0 +1,98 @@
+// Copyright © 2020 Mateus Carmo Martins de Freitas Barbosa
+//
+// This program is licensed under the GNU General Public License, version 3.
+// See LICENSE.txt.
+//
+
+#ifndef STACKTILE_TILING_H
+#define STACKTILE_TILING_H
+
+#include <stdint.h>
+#include <vector>
+#include "geometry.h"
+
+struct TileNode;
+struct TileTree;
+
+// A window laid out by a TileTree, embedded in whatever it places.
+struct TileWindow {
+    // NULL while the window isn't tiled.
+    TileTree *tree;
+    TileNode *stack;
+    Box box;
+    // Whether it's in tree->changed.
+    bool changed;
+    void *data;
+};
+
+enum TileSplit {
+    // A leaf. Its windows all take its whole box, one on top of the other.
+    TILE_STACK,
+    // Children side by side, left to right.
+    TILE_SPLIT_HORIZONTAL,
+    // Children one above the other, top to bottom.
+    TILE_SPLIT_VERTICAL,
+};
+
+struct TileNode {
+    TileNode *parent;
+    TileSplit split;
+    // The share of the parent's box. Siblings' weights add up to 1.
+    double weight;
+    Box box;
+    // Only for splits, which always have two children or more.
+    std::vector<TileNode*> children;
+    // Only for stacks, which always have a window or more.
+    std::vector<TileWindow*> windows;
+    // The window of the stack that was last activated.
+    TileWindow *active;
+};
+
+// Splits the area of an output into stacks of windows. Every change only
+// lays out again the subtree it affects, and within it only descends into
+// nodes whose box changed, so what it costs depends on how many windows
+// move rather than on how many there are.
+struct TileTree {
+    // NULL when the tree has no windows.
+    TileNode *root;
+    Box area;
+    // Windows whose box changed since the caller last cleared the list.
+    std::vector<TileWindow*> changed;
+};
+
+void tile_window_init(TileWindow *window, void *data);
+
+void tile_tree_init(TileTree *tree);
+// Frees the nodes. The tree must have no windows left.
+void tile_tree_finish(TileTree *tree);
+void tile_tree_set_area(TileTree *tree, const Box *area);
+// Resets window->changed for everything in tree->changed and empties it.
+void tile_tree_clear_changed(TileTree *tree);
+// Appends every window of the tree, stack by stack.
+void tile_tree_windows(const TileTree *tree, std::vector<TileWindow*> *windows);
+
+// Adds the window in a stack of its own next to near's, along its longer
+// side. It takes half of near's stack, or the average share when near's
+// siblings are split that way already. With near NULL or from another
+// tree, it goes next to the root instead. Removing the window gives back
+// what it took, in the same proportions.
+void tile_insert_split(TileTree *tree, TileWindow *window, TileWindow *near);
+// Adds the window on top of near's stack.
+void tile_insert_stacked(TileWindow *window, TileWindow *near);
+void tile_remove(TileWindow *window);
+
+// Makes the window the one its stack shows.
+void tile_activate(TileWindow *window);
+// Returns the window after this one in its stack, wrapping around.
+TileWindow *tile_stack_next(TileWindow *window);
+// Returns the active window of the nearest stack in the direction of one
+// of EDGE_LEFT, EDGE_RIGHT, EDGE_TOP and EDGE_BOTTOM, or NULL.
+TileWindow *tile_neighbor(TileWindow *window, uint32_t direction);
+// Takes a stacked window out into a new stack on that side of its stack,
+// or merges a window alone in its stack into the neighbouring one.
+void tile_move(TileWindow *window, uint32_t direction);
+// Widens the window's stack, or whatever contains it along that axis, by
+// amount of its parent's box, towards direction. Negative amounts shrink.
+void tile_grow(TileWindow *window, uint32_t direction, double amount);
+
+#endif /* STACKTILE_TILING_H */
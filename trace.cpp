@@ -0,0 +1,104 @@
+// Copyright © 2020 Mateus Carmo Martins de Freitas Barbosa
+//
+// This program is licensed under the GNU General Public License, version 3.
+// See LICENSE.txt.
+//
+
+#include <stdio.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "trace.h"
+
+struct TraceEvent {
+    const char *name;
+    int64_t start_nsec;
+    int64_t end_nsec;
+};
+
+struct TraceBuffer {
+    TraceEvent events[TRACE_BUFFER_EVENTS];
+    uint64_t count;
+    long tid;
+};
+
+bool trace_enabled = false;
+
+static std::string trace_path;
+// Every thread's buffer, registered on its first span. They're never
+// freed, as the thread may record again until the trace is written.
+static std::mutex trace_buffers_mutex;
+static std::vector<TraceBuffer*> trace_buffers;
+static thread_local TraceBuffer *trace_buffer = NULL;
+
+bool trace_init(const char *path) {
+    FILE *file = fopen(path, "w");
+    if (file == NULL) {
+        return false;
+    }
+    fclose(file);
+    trace_path = path;
+    trace_enabled = true;
+    return true;
+}
+
+int64_t trace_now_nsec() {
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+void trace_record(const char *name, int64_t start_nsec, int64_t end_nsec) {
+    if (trace_buffer == NULL) {
+        trace_buffer = new TraceBuffer;
+        trace_buffer->count = 0;
+        trace_buffer->tid = syscall(SYS_gettid);
+        std::lock_guard<std::mutex> lock(trace_buffers_mutex);
+        trace_buffers.push_back(trace_buffer);
+    }
+    TraceEvent *event = &trace_buffer->events[trace_buffer->count % TRACE_BUFFER_EVENTS];
+    event->name = name;
+    event->start_nsec = start_nsec;
+    event->end_nsec = end_nsec;
+    trace_buffer->count++;
+}
+
+void trace_finish() {
+    if (!trace_enabled) {
+        return;
+    }
+    trace_enabled = false;
+
+    FILE *file = fopen(trace_path.c_str(), "w");
+    if (file == NULL) {
+        return;
+    }
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    bool first = true;
+    long pid = getpid();
+    std::lock_guard<std::mutex> lock(trace_buffers_mutex);
+    for (TraceBuffer *buffer : trace_buffers) {
+        uint64_t count = std::min<uint64_t>(buffer->count, TRACE_BUFFER_EVENTS);
+        // Oldest first.
+        for (uint64_t i = buffer->count - count; i < buffer->count; i++) {
+            const TraceEvent *event = &buffer->events[i % TRACE_BUFFER_EVENTS];
+            fprintf(file,
+                    "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%ld,\"tid\":%ld,"
+                    "\"ts\":%.3f,\"dur\":%.3f}",
+                    first ? "" : ",\n",
+                    event->name,
+                    pid,
+                    buffer->tid,
+                    event->start_nsec / 1000.0,
+                    (event->end_nsec - event->start_nsec) / 1000.0);
+            first = false;
+        }
+    }
+    fprintf(file, "\n]}\n");
+    fclose(file);
+}
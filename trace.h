@@ -0,0 +1,49 @@
+// Copyright © 2020 Mateus Carmo Martins de Freitas Barbosa
+//
+// This program is licensed under the GNU General Public License, version 3.
+// See LICENSE.txt.
+//
+
+#ifndef STACKTILE_TRACE_H
+#define STACKTILE_TRACE_H
+
+#include <stdint.h>
+
+// Spans are recorded into a ring buffer per thread, which keeps the latest
+// TRACE_BUFFER_EVENTS of them, and written out as Chrome trace JSON (which
+// Perfetto opens too) when tracing finishes. While tracing is off a span
+// costs a single branch.
+static const int TRACE_BUFFER_EVENTS = 1 << 16;
+
+extern bool trace_enabled;
+
+bool trace_init(const char *path);
+// Writes the trace file.
+void trace_finish();
+
+int64_t trace_now_nsec();
+// name must be a string literal, or otherwise outlive the trace.
+void trace_record(const char *name, int64_t start_nsec, int64_t end_nsec);
+
+struct TraceScope {
+    const char *name;
+    int64_t start_nsec;
+
+    TraceScope(const char *name) : name(name), start_nsec(0) {
+        if (trace_enabled) {
+            start_nsec = trace_now_nsec();
+        }
+    }
+    ~TraceScope() {
+        if (trace_enabled && start_nsec != 0) {
+            trace_record(name, start_nsec, trace_now_nsec());
+        }
+    }
+};
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+// Records a span from here to the end of the enclosing block.
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(trace_scope_, __LINE__)(name)
+
+#endif /* STACKTILE_TRACE_H */
@@ -0,0 +1,226 @@
+// Copyright © 2020 Mateus Carmo Martins de Freitas Barbosa
+//
+// This program is licensed under the GNU General Public License, version 3.
+// See LICENSE.txt.
+//
+
+#include <wayland-server-core.h>
+
+extern "C" {
+#define static
+
+#include <wlr/types/wlr_box.h>
+#include <wlr/types/wlr_output.h>
+#include <wlr/types/wlr_xdg_shell.h>
+#include <wlr/util/edges.h>
+#include <wlr/util/log.h>
+
+#undef static
+}
+
+#include "output.h"
+#include "server.h"
+#include "trace.h"
+#include "transaction.h"
+#include "view.h"
+
+// How long we wait for slow clients before applying a transaction anyway.
+static const int TRANSACTION_TIMEOUT_MS = 200;
+
+static void box_add(wlr_box *area, const wlr_box *box) {
+    if (area->width <= 0 || area->height <= 0) {
+        *area = *box;
+        return;
+    }
+    int x1 = area->x < box->x ? area->x : box->x;
+    int y1 = area->y < box->y ? area->y : box->y;
+    int x2 = area->x + area->width;
+    int y2 = area->y + area->height;
+    if (box->x + box->width > x2) {
+        x2 = box->x + box->width;
+    }
+    if (box->y + box->height > y2) {
+        y2 = box->y + box->height;
+    }
+    *area = { x1, y1, x2 - x1, y2 - y1 };
+}
+
+static void transaction_destroy(Transaction *transaction) {
+    if (transaction->timer != NULL) {
+        wl_event_source_remove(transaction->timer);
+    }
+    delete transaction;
+}
+
+static void transaction_apply(Transaction *transaction) {
+    TRACE_SCOPE("transaction_apply");
+    Server *server = transaction->server;
+    for (TransactionInstruction &instruction : transaction->instructions) {
+        View *view = instruction.view;
+        // Place the window geometry the client actually committed, which
+        // may not be the size asked for, against the edges that don't move.
+        wlr_box geo_box;
+        wlr_xdg_surface_get_geometry(view->xdg_surface, &geo_box);
+        const wlr_box *geometry = &instruction.geometry;
+        int x = geometry->x, y = geometry->y;
+        if ((instruction.edges & WLR_EDGE_LEFT) && !(instruction.edges & WLR_EDGE_RIGHT)) {
+            x = geometry->x + geometry->width - geo_box.width;
+        }
+        if ((instruction.edges & WLR_EDGE_TOP) && !(instruction.edges & WLR_EDGE_BOTTOM)) {
+            y = geometry->y + geometry->height - geo_box.height;
+        }
+        view_move(view, x - geo_box.x, y - geo_box.y);
+    }
+
+    // Outputs held back by the transaction may have skipped frames.
+    Output *output;
+    wl_list_for_each(output, &server->outputs, link) {
+        if (output_intersects(output, &transaction->area)) {
+            wlr_output_schedule_frame(output->output);
+        }
+    }
+
+    server->inflight_transaction = NULL;
+    transaction_destroy(transaction);
+    transaction_commit_dirty(server);
+}
+
+static int transaction_timeout(void *data) {
+    auto transaction = reinterpret_cast<Transaction*>(data);
+    wlr_log(WLR_DEBUG, "Transaction timed out with %d views pending", transaction->pending);
+    transaction_apply(transaction);
+    return 0;
+}
+
+void view_configure(View *view, const wlr_box *geometry) {
+    Server *server = view->server;
+    Transaction *transaction = server->pending_transaction;
+    if (transaction == NULL) {
+        transaction = new Transaction;
+        transaction->server = server;
+        transaction->pending = 0;
+        transaction->area = { 0, 0, 0, 0 };
+        transaction->timer = NULL;
+        server->pending_transaction = transaction;
+    }
+
+    for (TransactionInstruction &instruction : transaction->instructions) {
+        if (instruction.view == view) {
+            instruction.geometry = *geometry;
+            return;
+        }
+    }
+    transaction->instructions.push_back({ view, *geometry, WLR_EDGE_NONE, 0, false });
+}
+
+void transaction_commit_dirty(Server *server) {
+    Transaction *transaction = server->pending_transaction;
+    if (transaction == NULL || server->inflight_transaction != NULL) {
+        return;
+    }
+    server->pending_transaction = NULL;
+    server->inflight_transaction = transaction;
+
+    for (TransactionInstruction &instruction : transaction->instructions) {
+        View *view = instruction.view;
+        wlr_box geo_box;
+        wlr_xdg_surface_get_geometry(view->xdg_surface, &geo_box);
+
+        box_add(&transaction->area, &view->box);
+        box_add(&transaction->area, &instruction.geometry);
+
+        const wlr_box *geometry = &instruction.geometry;
+        int x = view->x + geo_box.x, y = view->y + geo_box.y;
+        instruction.edges = WLR_EDGE_NONE;
+        if (geometry->x != x) {
+            instruction.edges |= WLR_EDGE_LEFT;
+        }
+        if (geometry->x + geometry->width != x + geo_box.width) {
+            instruction.edges |= WLR_EDGE_RIGHT;
+        }
+        if (geometry->y != y) {
+            instruction.edges |= WLR_EDGE_TOP;
+        }
+        if (geometry->y + geometry->height != y + geo_box.height) {
+            instruction.edges |= WLR_EDGE_BOTTOM;
+        }
+
+        if (geo_box.width == instruction.geometry.width &&
+            geo_box.height == instruction.geometry.height) {
+            instruction.ready = true;
+            continue;
+        }
+        instruction.serial = wlr_xdg_toplevel_set_size(
+            view->xdg_surface,
+            instruction.geometry.width,
+            instruction.geometry.height
+        );
+        transaction->pending++;
+    }
+
+    if (transaction->pending == 0) {
+        transaction_apply(transaction);
+        return;
+    }
+    transaction->timer = wl_event_loop_add_timer(
+        wl_display_get_event_loop(server->display),
+        transaction_timeout,
+        transaction
+    );
+    wl_event_source_timer_update(transaction->timer, TRANSACTION_TIMEOUT_MS);
+}
+
+void transaction_notify_commit(View *view) {
+    Transaction *transaction = view->server->inflight_transaction;
+    if (transaction == NULL) {
+        return;
+    }
+    for (TransactionInstruction &instruction : transaction->instructions) {
+        if (instruction.view != view || instruction.ready) {
+            continue;
+        }
+        // The client may have acked a later configure as well.
+        uint32_t acked = view->xdg_surface->configure_serial;
+        if (static_cast<int32_t>(acked - instruction.serial) < 0) {
+            return;
+        }
+        instruction.ready = true;
+        if (--transaction->pending == 0) {
+            transaction_apply(transaction);
+        }
+        return;
+    }
+}
+
+static void remove_instruction(Transaction *transaction, View *view) {
+    auto &instructions = transaction->instructions;
+    for (auto it = instructions.begin(); it != instructions.end(); ++it) {
+        if (it->view != view) {
+            continue;
+        }
+        if (!it->ready && transaction->timer != NULL) {
+            transaction->pending--;
+        }
+        instructions.erase(it);
+        return;
+    }
+}
+
+void transaction_remove_view(View *view) {
+    Server *server = view->server;
+    if (server->pending_transaction != NULL) {
+        remove_instruction(server->pending_transaction, view);
+    }
+    Transaction *transaction = server->inflight_transaction;
+    if (transaction != NULL) {
+        remove_instruction(transaction, view);
+        if (transaction->pending == 0) {
+            transaction_apply(transaction);
+        }
+    }
+}
+
+bool transaction_blocks_output(Server *server, Output *output) {
+    Transaction *transaction = server->inflight_transaction;
+    return transaction != NULL && output_intersects(output, &transaction->area);
+}
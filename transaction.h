@@ -0,0 +1,60 @@
+// Copyright © 2020 Mateus Carmo Martins de Freitas Barbosa
+//
+// This program is licensed under the GNU General Public License, version 3.
+// See LICENSE.txt.
+//
+
+#ifndef STACKTILE_TRANSACTION_H
+#define STACKTILE_TRANSACTION_H
+
+#include <stdint.h>
+#include <vector>
+#include <wayland-server-core.h>
+
+struct Output;
+struct Server;
+struct View;
+
+// Geometry changes are gathered into a transaction and applied all at once,
+// when every client involved has committed a buffer at its new size or the
+// transaction times out. Only one transaction is in flight at a time, and
+// changes made meanwhile are coalesced into the next one, so a view never
+// has more than one configure waiting for the client.
+struct TransactionInstruction {
+    View *view;
+    // The window geometry to reach, in layout coordinates.
+    wlr_box geometry;
+    // The edges that move, as WLR_EDGE_* bits, worked out when the
+    // transaction starts. The others stay put whatever size the client
+    // ends up committing.
+    uint32_t edges;
+    uint32_t serial;
+    bool ready;
+};
+
+struct Transaction {
+    Server *server;
+    std::vector<TransactionInstruction> instructions;
+    int pending;
+    // Everything the transaction moves views from and to, in layout
+    // coordinates. Outputs showing any of it hold their repaints until the
+    // transaction is applied.
+    wlr_box area;
+    wl_event_source *timer;
+};
+
+// Queues a new window geometry for the view.
+void view_configure(View *view, const wlr_box *geometry);
+
+// Starts the queued transaction, unless one is still in flight.
+void transaction_commit_dirty(Server *server);
+
+// Called when the view's toplevel surface commits.
+void transaction_notify_commit(View *view);
+
+// Forgets about the view, which is going away.
+void transaction_remove_view(View *view);
+
+bool transaction_blocks_output(Server *server, Output *output);
+
+#endif /* STACKTILE_TRANSACTION_H */
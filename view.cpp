@@ -10,15 +10,208 @@ extern "C" {
 #define static
 
 #include <wlr/types/wlr_cursor.h>
+#include <wlr/types/wlr_output.h>
+#include <wlr/types/wlr_surface.h>
 #include <wlr/types/wlr_xdg_shell.h>
 #include <wlr/util/edges.h>
 
 #undef static
 }
 
+#include "arrange.h"
+#include "output.h"
 #include "server.h"
+#include "surface.h"
+#include "trace.h"
+#include "transaction.h"
 #include "view.h"
 
+struct ViewBoxData {
+    View *view;
+    wlr_box box;
+    // How many surfaces were walked, and whether any of them differs from
+    // the view's render entries.
+    size_t surfaces;
+    bool render_changed;
+};
+
+static void view_box_iterator(wlr_surface *surface,
+                              int sx, int sy,
+                              void *data) {
+    auto bdata = reinterpret_cast<ViewBoxData*>(data);
+    if (!bdata->render_changed &&
+        !render_list_view_entry_matches(bdata->view, bdata->surfaces, surface, sx, sy)) {
+        bdata->render_changed = true;
+    }
+    bdata->surfaces++;
+
+    wlr_box *box = &bdata->box;
+    int x1 = sx < box->x ? sx : box->x;
+    int y1 = sy < box->y ? sy : box->y;
+    int x2 = sx + surface->current.width;
+    int y2 = sy + surface->current.height;
+    if (box->x + box->width > x2) {
+        x2 = box->x + box->width;
+    }
+    if (box->y + box->height > y2) {
+        y2 = box->y + box->height;
+    }
+    *box = { x1, y1, x2 - x1, y2 - y1 };
+}
+
+static void update_outputs_iterator(wlr_surface *surface,
+                                    int sx, int sy,
+                                    void *data) {
+    View *view = reinterpret_cast<View*>(data);
+    auto surface_state = reinterpret_cast<Surface*>(surface->data);
+    if (surface_state == NULL) {
+        return;
+    }
+    wlr_box box {
+        view->x + sx,
+        view->y + sy,
+        surface->current.width,
+        surface->current.height,
+    };
+    surface_update_outputs(surface_state, &box);
+}
+
+void view_update_outputs(View *view) {
+    wlr_xdg_surface_for_each_surface(view->xdg_surface, update_outputs_iterator, view);
+}
+
+static void leave_outputs_iterator(wlr_surface *surface,
+                                   int sx, int sy,
+                                   void *data) {
+    auto surface_state = reinterpret_cast<Surface*>(surface->data);
+    if (surface_state != NULL) {
+        surface_leave_outputs(surface_state);
+    }
+}
+
+static void view_update_grid(View *view) {
+    Box box { view->box.x, view->box.y, view->box.width, view->box.height };
+    grid_update(&view->server->view_grid, &view->grid_item, &box, view->z);
+}
+
+// Returns true if the bounding box changed. The view's render entries are
+// only rebuilt when some surface moved, resized or came and went.
+static bool view_update_box(View *view) {
+    ViewBoxData bdata { view, { 0, 0, 0, 0 }, 0, false };
+    wlr_xdg_surface_for_each_surface(view->xdg_surface, view_box_iterator, &bdata);
+    if (bdata.render_changed || bdata.surfaces != view->render_entries.size()) {
+        render_list_invalidate_view(view);
+    }
+    wlr_box box = bdata.box;
+    box.x += view->x;
+    box.y += view->y;
+
+    bool changed = box.x != view->box.x || box.y != view->box.y ||
+        box.width != view->box.width || box.height != view->box.height;
+    view->box = box;
+    if (view->mapped) {
+        view_update_grid(view);
+        if (changed) {
+            view_update_outputs(view);
+        }
+    }
+    return changed;
+}
+
+void view_damage_whole(View *view) {
+    Output *output;
+    wl_list_for_each(output, &view->server->outputs, link) {
+        output_damage_box(output, &view->box);
+    }
+}
+
+struct SurfaceDamageData {
+    View *view;
+    wlr_surface *target;
+};
+
+static void damage_surface_iterator(wlr_surface *surface,
+                                    int sx, int sy,
+                                    void *data) {
+    auto ddata = reinterpret_cast<SurfaceDamageData*>(data);
+    if (surface != ddata->target) {
+        return;
+    }
+    View *view = ddata->view;
+    auto surface_state = reinterpret_cast<Surface*>(surface->data);
+    uint32_t frame_output = 0;
+    if (surface_state != NULL) {
+        // The surface itself may have been resized.
+        update_outputs_iterator(surface, sx, sy, view);
+        frame_output = surface_frame_output(surface_state);
+    }
+    bool frame_pending = !wl_list_empty(&surface->current.frame_callback_list);
+
+    Output *output;
+    wl_list_for_each(output, &view->server->outputs, link) {
+        output_damage_surface(output, surface, view->x + sx, view->y + sy, false);
+        if (frame_pending && (frame_output & output->mask)) {
+            // The client is waiting for a frame callback, which is only sent
+            // from the frame handler, even if there's nothing to repaint.
+            wlr_output_schedule_frame(output->output);
+        }
+    }
+}
+
+void view_damage_surface(View *view, wlr_surface *surface) {
+    wlr_box old_box = view->box;
+    if (view_update_box(view)) {
+        // Something in the surface tree was resized or moved.
+        Output *output;
+        wl_list_for_each(output, &view->server->outputs, link) {
+            output_damage_box(output, &old_box);
+        }
+        view_damage_whole(view);
+    }
+
+    SurfaceDamageData ddata { view, surface };
+    wlr_xdg_surface_for_each_surface(
+        view->xdg_surface,
+        damage_surface_iterator,
+        &ddata
+    );
+}
+
+void view_move(View *view, int x, int y) {
+    if (view->x == x && view->y == y) {
+        return;
+    }
+    view_damage_whole(view);
+    view->x = x;
+    view->y = y;
+    view_update_box(view);
+    view_damage_whole(view);
+}
+
+View *view_from_surface(wlr_surface *surface) {
+    // Walk up subsurface and popup parents until we reach a toplevel.
+    // Surfaces keep their role after the role object is destroyed, which
+    // leaves them without a parent.
+    while (surface != NULL) {
+        if (wlr_surface_is_subsurface(surface)) {
+            wlr_subsurface *subsurface = wlr_subsurface_from_wlr_surface(surface);
+            surface = subsurface != NULL ? subsurface->parent : NULL;
+        } else if (wlr_surface_is_xdg_surface(surface)) {
+            wlr_xdg_surface *xdg_surface = wlr_xdg_surface_from_wlr_surface(surface);
+            if (xdg_surface == NULL) {
+                return NULL;
+            }
+            if (xdg_surface->role != WLR_XDG_SURFACE_ROLE_POPUP) {
+                return reinterpret_cast<View*>(xdg_surface->data);
+            }
+            surface = xdg_surface->popup->parent;
+        } else {
+            return NULL;
+        }
+    }
+    return NULL;
+}
+
 void focus_view(View *view, wlr_surface *surface) {
     // Note: this function only deals with keyboard focus.
     if (view == NULL) {
@@ -40,10 +233,12 @@ void focus_view(View *view, wlr_surface *surface) {
     wlr_keyboard *keyboard = wlr_seat_get_keyboard(seat);
 
     // Move the view to the front
-    wl_list_remove(&view->link);
-    wl_list_insert(&server->views, &view->link);
+    if (server->views.next != &view->link) {
+        view_raise(view);
+    }
 
     wlr_xdg_toplevel_set_activated(view->xdg_surface, true);
+    tile_activate(&view->tile);
     wlr_seat_keyboard_notify_enter(
         seat,
         view->xdg_surface->surface,
@@ -53,6 +248,30 @@ void focus_view(View *view, wlr_surface *surface) {
     );
 }
 
+void view_raise(View *view) {
+    Server *server = view->server;
+    wl_list_remove(&view->link);
+    wl_list_insert(&server->views, &view->link);
+    view->z = stacking_raise(&server->stacking);
+    if (view->mapped) {
+        view_update_grid(view);
+    }
+    render_list_invalidate(server);
+    view_damage_whole(view);
+}
+
+void view_lower(View *view) {
+    Server *server = view->server;
+    wl_list_remove(&view->link);
+    wl_list_insert(server->views.prev, &view->link);
+    view->z = stacking_lower(&server->stacking);
+    if (view->mapped) {
+        view_update_grid(view);
+    }
+    render_list_invalidate(server);
+    view_damage_whole(view);
+}
+
 static bool view_at(View *view,
                     double lx, double ly,
                     wlr_surface **surface,
@@ -79,9 +298,18 @@ View *desktop_view_at(Server *server,
                       double lx, double ly,
                       wlr_surface **surface,
                       double *sx, double *sy) {
-    // This relies on server->views being ordered from top-to-bottom.
-    View *view;
-    wl_list_for_each(view, &server->views, link) {
+    TRACE_SCOPE("desktop_view_at");
+    // Only the views indexed around the point are candidates, and they come
+    // ordered from top-to-bottom.
+    const std::vector<GridItem*> *items = grid_items_at(&server->view_grid, lx, ly);
+    if (items == NULL) {
+        return NULL;
+    }
+    for (GridItem *item : *items) {
+        if (!box_contains_point(&item->box, lx, ly)) {
+            continue;
+        }
+        auto view = reinterpret_cast<View*>(item->data);
         if (view_at(view, lx, ly, surface, sx, sy)) {
             return view;
         }
@@ -90,20 +318,37 @@ View *desktop_view_at(Server *server,
 }
 
 static void xdg_surface_map(wl_listener *listener, void *data) {
+    TRACE_SCOPE("xdg_surface_map");
     View *view = wl_container_of(listener, view, map);
     view->mapped = true;
+    // The box may be the same as when the view was last unmapped, but
+    // the surfaces have left their outputs since.
+    view_update_box(view);
+    view_update_outputs(view);
+    view_damage_whole(view);
+    arrange_view_map(view);
     focus_view(view, view->xdg_surface->surface);
 }
 
 static void xdg_surface_unmap(wl_listener *listener, void *data) {
+    TRACE_SCOPE("xdg_surface_unmap");
     View *view = wl_container_of(listener, view, unmap);
     view->mapped = false;
+    grid_remove(&view->server->view_grid, &view->grid_item);
+    render_list_invalidate(view->server);
+    transaction_remove_view(view);
+    arrange_view_unmap(view);
+    wlr_xdg_surface_for_each_surface(view->xdg_surface, leave_outputs_iterator, NULL);
+    // The surface has no buffer anymore, so we damage where it last was.
+    view_damage_whole(view);
 }
 
 static void xdg_surface_destroy(wl_listener *listener, void *data) {
     View *view = wl_container_of(listener, view, destroy);
+    transaction_remove_view(view);
     wl_list_remove(&view->link);
-    free(view);
+    render_list_invalidate(view->server);
+    delete view;
 }
 
 static void begin_interactive(View *view,
@@ -114,6 +359,10 @@ static void begin_interactive(View *view,
     if (view->xdg_surface->surface != focused_surface) {
         return;
     }
+    if (view->tile.tree != NULL) {
+        // Tiled views go where their tree puts them.
+        return;
+    }
     server->grabbed_view = view;
     server->cursor_mode = mode;
 
@@ -171,6 +420,14 @@ void handle_new_xdg_surface(wl_listener *listener, void *data) {
     View *view = new View;
     view->server = server;
     view->xdg_surface = xdg_surface;
+    view->mapped = false;
+    view->x = view->y = 0;
+    view->box = { 0, 0, 0, 0 };
+    view->z = stacking_raise(&server->stacking);
+    grid_item_init(&view->grid_item, view);
+    tile_window_init(&view->tile, view);
+    view->render_dirty = true;
+    xdg_surface->data = view;
 
     view->map.notify = xdg_surface_map;
     wl_signal_add(&xdg_surface->events.map, &view->map);
@@ -8,6 +8,10 @@
 #define STACKTILE_VIEW_H
 
 #include <wayland-server-core.h>
+#include <vector>
+#include "grid.h"
+#include "renderlist.h"
+#include "tiling.h"
 
 struct wlr_xdg_surface;
 struct wlr_surface;
@@ -24,15 +28,36 @@ struct View {
     wl_listener request_resize;
     bool mapped;
     int x, y;
+    // Bounding box of the whole surface tree, in layout coordinates.
+    wlr_box box;
+    // Stacking position, higher is closer to the top.
+    int64_t z;
+    // The view's entry in the server's view grid, while mapped.
+    GridItem grid_item;
+    // The view's part of the server's render list.
+    std::vector<RenderListEntry> render_entries;
+    bool render_dirty;
+    // The view's place in its output's tiles, see arrange.h.
+    TileWindow tile;
 };
 
 void focus_view(View *view, wlr_surface *surface);
+// Restack the view above or below every other view.
+void view_raise(View *view);
+void view_lower(View *view);
 
 View *desktop_view_at(Server *server,
                       double lx, double ly,
                       wlr_surface **surface,
                       double *sx, double *sy);
 
+View *view_from_surface(wlr_surface *surface);
+
+void view_move(View *view, int x, int y);
+void view_update_outputs(View *view);
+void view_damage_whole(View *view);
+void view_damage_surface(View *view, wlr_surface *surface);
+
 void handle_new_xdg_surface(wl_listener *listener, void *data);
 
 #endif /* STACKTILE_VIEW_H */